@@ -1,9 +1,44 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "ImageStuff.h"
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+
+// These programs handle one layout only: uncompressed 24-bit pixels right after
+// the 54-byte header, of which 'got' bytes were read. Prints why and returns -1
+// for anything else
+int CheckBMPHeader(const unsigned char* h, size_t got, char* filename)
+{
+	unsigned int offset = *(unsigned int*)&h[10];
+	unsigned int compression = *(unsigned int*)&h[30];
+	int bits = *(unsigned short*)&h[28];
+
+	if(got != 54 || h[0] != 'B' || h[1] != 'M')
+	{
+		printf("\n\n%s is not a BMP file\n\n",filename);
+		return -1;
+	}
+	if(bits != 24 || compression != 0 || offset != 54)
+	{
+		printf("\n\n%s: unsupported BMP (%d bits per pixel, compression %u, pixels at byte %u), "
+		       "only uncompressed 24-bit images are handled\n\n",
+		       filename, bits, compression, offset);
+		return -1;
+	}
+	return 0;
+}
 
 unsigned char** ReadBMP(char* filename)
 {
@@ -16,7 +51,8 @@ unsigned char** ReadBMP(char* filename)
 	}
 
 	unsigned char HeaderInfo[54];
-	fread(HeaderInfo, sizeof(unsigned char), 54, f); // read the 54-byte header
+	size_t got = fread(HeaderInfo, sizeof(unsigned char), 54, f); // read the 54-byte header
+	if(CheckBMPHeader(HeaderInfo, got, filename) != 0) exit(1);
 
 	// extract image height and width from header
 	int width = *(int*)&HeaderInfo[18];
@@ -34,47 +70,97 @@ unsigned char** ReadBMP(char* filename)
 
 	printf("\n   Input BMP File name: %20s  (%u x %u)",filename,ip.Hpixels,ip.Vpixels);
 
-	unsigned char tmp;
 	unsigned char **TheImage = (unsigned char **)malloc(height * sizeof(unsigned char*));
 	for(i=0; i<height; i++) {
 		TheImage[i] = (unsigned char *)malloc(RowBytes * sizeof(unsigned char));
 	}
 
-	for(i = 0; i < height; i++) {
-		fread(TheImage[i], sizeof(unsigned char), RowBytes, f);
+	// map the file instead of issuing one fread per row; a short file only
+	// maps and copies the pixel bytes it actually has
+	size_t mapBytes = 54 + (size_t)height * RowBytes;
+	struct stat st;
+	if(fstat(fileno(f), &st) != 0)
+	{
+		printf("\n\nCannot stat %s\n\n",filename);
+		exit(1);
 	}
-
+	if((size_t)st.st_size <= 54) {
+		fclose(f);
+		return TheImage;
+	}
+	if((size_t)st.st_size < mapBytes) mapBytes = (size_t)st.st_size;
+	size_t pixelBytes = mapBytes - 54;
+	unsigned char *map = (unsigned char *)mmap(NULL, mapBytes, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	if(map == MAP_FAILED)
+	{
+		printf("\n\nCannot mmap %s\n\n",filename);
+		exit(1);
+	}
+	madvise(map, mapBytes, MADV_SEQUENTIAL);
+	for(i = 0; i < height && (size_t)i * RowBytes < pixelBytes; i++) {
+		size_t left = pixelBytes - (size_t)i * RowBytes;
+		memcpy(TheImage[i], map + 54 + (size_t)i * RowBytes, left < (size_t)RowBytes ? left : (size_t)RowBytes);
+	}
+	munmap(map, mapBytes);
 
 	fclose(f);
 	return TheImage;  // remember to free() it in caller!
 }
 
+// writev() every iovec completely, resuming after partial writes
+static void WriteAllV(int fd, struct iovec* iov, int cnt, char* filename)
+{
+	ssize_t put;
+
+	while(cnt > 0)
+	{
+		put = writev(fd, iov, cnt > IOV_MAX ? IOV_MAX : cnt);
+		if(put < 0)
+		{
+			printf("\n\nFILE WRITE ERROR: %s\n\n",filename);
+			exit(1);
+		}
+		while(cnt > 0 && (size_t)put >= iov->iov_len) {
+			put -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if(cnt > 0) {
+			iov->iov_base = (char*)iov->iov_base + put;
+			iov->iov_len -= put;
+		}
+	}
+}
+
+// Writes the header and all rows with writev(), straight from the row
+// pointers, instead of one fputc() per byte
 void WriteBMP(unsigned char** img, char* filename)
 {
-	FILE* f = fopen(filename, "wb");
-	if(f == NULL)
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
 	{
 		printf("\n\nFILE CREATION ERROR: %s\n\n",filename);
 		exit(1);
 	}
 
-	unsigned long int x,y;
-	char temp;
-
-	//write header
-	for(x=0; x<54; x++) {
-		fputc(ip.HeaderInfo[x],f);
+	int x;
+	struct iovec* iov = (struct iovec*)malloc((ip.Vpixels + 1) * sizeof(struct iovec));
+	if(iov == NULL)
+	{
+		printf("\n\nCannot allocate the output iovecs\n\n");
+		exit(1);
 	}
 
-	//write data
+	//header, then data
+	iov[0].iov_base = ip.HeaderInfo;
+	iov[0].iov_len = 54;
 	for(x=0; x<ip.Vpixels; x++) {
-		for(y=0; y<ip.Hbytes; y++)
-		{
-			temp=img[x][y];
-			fputc(temp,f);
-		}
+		iov[x + 1].iov_base = img[x];
+		iov[x + 1].iov_len = ip.Hbytes;
 	}
+	WriteAllV(fd, iov, ip.Vpixels + 1, filename);
 	printf("\n  Output BMP File name: %20s  (%u x %u)",filename,ip.Hpixels,ip.Vpixels);
 
-	fclose(f);
+	free(iov);
+	close(fd);
 }
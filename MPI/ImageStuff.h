@@ -14,6 +14,7 @@ struct Pixel
 	unsigned char B;
 };
 
+int CheckBMPHeader(const unsigned char* , size_t , char* );
 unsigned char** ReadBMP(char* );
 void WriteBMP(unsigned char** , char*);
 
@@ -5,17 +5,23 @@
 #include <stdio.h>
 #include <sys/time.h>
 #include <string.h>
+#include <unistd.h>
 #include "ImageStuff.h"
+#include "Numa.h"
+#include "Perf.h"
+#include "PixelReverse.h"
+#include "StreamFlip.h"
+#include "ThreadPool.h"
 
 #define REPS 	     1
-#define MAXTHREADS   128
+#define MAXTHREADS   POOL_MAXTHREADS
+#define SWAP_CHUNK	 4096		// bytes of a row pair swapped at a time
 
 long  			NumThreads;         		// Total number of threads working in parallel
-int 	     	ThParam[MAXTHREADS];		// Thread parameters ...
-pthread_t      	ThHandle[MAXTHREADS];		// Thread handles
-pthread_attr_t 	ThAttr;						// Pthread attrributes
 void (*FlipFunc)(unsigned char* img);		// Function pointer to flip the image
-void* (*MTFlipFunc)(void *arg);				// Function pointer to flip the image, multi-threaded version
+PoolWork		MTFlipFunc;					// Function pointer to flip a range of rows, multi-threaded version
+int				PerfOn;						// -p: read the hardware counters around the flips
+long			MTItems;					// Row pairs MTFlipFunc covers, the middle row of an odd height pairs with itself
 
 unsigned char*	TheImage;					// This is the main image
 struct ImgProp 	ip;
@@ -62,100 +68,73 @@ void FlipImageV(unsigned char* img)
 
 void FlipImageH(unsigned char* img)
 {
-	struct Pixel pix;
-	int row, col, opp;
+	int row;
 
 	for(row = 0; row < ip.Vpixels; row++)
 	{
-		col = 0;
-		while(col < (ip.Hpixels * 3) / 2)
-		{
-			opp = ip.Hpixels * 3 - (col + 3);
-			int rowStart = row * ip.Hbytes;
+		ReverseRow24(&img[row * ip.Hbytes], ip.Hpixels);
+	}
+}
 
-			pix.B = img[rowStart + col];
-			pix.G = img[rowStart + col + 1];
-			pix.R = img[rowStart + col + 2];
 
-			img[rowStart + col]     = img[rowStart + opp];
-			img[rowStart + col + 1] = img[rowStart + opp + 1];
-			img[rowStart + col + 2] = img[rowStart + opp + 2];
 
-			img[rowStart + opp]     = pix.B;
-			img[rowStart + opp + 1] = pix.G;
-			img[rowStart + opp + 2] = pix.R;
+// Pool job: swaps the rows [first, last) of img with their mirrors,
+// a chunk at a time through a stack buffer
+void MTFlipV(long first, long last, void* img)
+{
+	unsigned char Buffer[SWAP_CHUNK];
+	unsigned char *top, *bottom;
+	unsigned long off, len;
+	long row;
 
-			col += 3;
+	for(row = first; row < last; row++)
+	{
+		top = (uch*)img + row * ip.Hbytes;
+		bottom = (uch*)img + (ip.Vpixels - row - 1) * ip.Hbytes;
+		if(top == bottom) continue;
+		for(off = 0; off < ip.Hbytes; off += len)
+		{
+			len = (ip.Hbytes - off < SWAP_CHUNK) ? ip.Hbytes - off : SWAP_CHUNK;
+			memcpy(Buffer, top + off, len);
+			memcpy(top + off, bottom + off, len);
+			memcpy(bottom + off, Buffer, len);
 		}
 	}
 }
 
 
-
-void *MTFlipV(void* tid)
+// Pool job: mirrors the rows [first, last) of img and their mirrored rows,
+// so the H flip splits the image like the V flip does
+void MTFlipH(long first, long last, void* img)
 {
-	struct Pixel pix;
-	int row, row2;
-	unsigned char* Buffer  = malloc(ip.Hbytes);
-	unsigned char* Buffer2 = malloc(ip.Hbytes);
+	long row, row2;
 
-	if (!Buffer || !Buffer2) {
-		fprintf(stderr, "Error allocating row buffers\n");
-		exit(EXIT_FAILURE);
-	}
-
-	long ts = *((int *) tid);
-	ts *= ip.Vpixels / NumThreads / 2;
-	long te = ts + (ip.Vpixels / NumThreads / 2) - 1;
-
-	for (row = ts; row <= te; row++) {
+	for(row = first; row < last; row++)
+	{
 		row2 = ip.Vpixels - row - 1;
-
-		memcpy(Buffer,  &TheImage[row * ip.Hbytes], ip.Hbytes);
-		memcpy(Buffer2, &TheImage[row2 * ip.Hbytes], ip.Hbytes);
-
-		memcpy(&TheImage[row * ip.Hbytes],  Buffer2, ip.Hbytes);
-		memcpy(&TheImage[row2 * ip.Hbytes], Buffer,  ip.Hbytes);
+		ReverseRow24((uch*)img + row * ip.Hbytes, ip.Hpixels);
+		if(row2 != row) ReverseRow24((uch*)img + row2 * ip.Hbytes, ip.Hpixels);
 	}
-	free(Buffer);
-	free(Buffer2);
-	pthread_exit(NULL);
 }
 
-
-void *MTFlipH(void* tid)
+// Pool job, NUMA mode: faults in the rows [first, last) of img and their
+// mirrored rows from the worker that the flips will deal them to
+void MTTouch(long first, long last, void* img)
 {
-	struct Pixel pix;
-	int row, col, opp;
-
-	long ts = *((int *) tid);
-	ts *= ip.Vpixels / NumThreads;
-	long te = ts + ip.Vpixels / NumThreads - 1;
+	long row;
 
-	for(row = ts; row <= te; row++)
+	for(row = first; row < last; row++)
 	{
-		col = 0;
-		while(col < (ip.Hpixels * 3) / 2)
-		{
-			opp = ip.Hpixels * 3 - (col + 3);
-			int rowStart = row * ip.Hbytes;
-
-			pix.B = TheImage[rowStart + col];
-			pix.G = TheImage[rowStart + col + 1];
-			pix.R = TheImage[rowStart + col + 2];
-
-			TheImage[rowStart + col]     = TheImage[rowStart + opp];
-			TheImage[rowStart + col + 1] = TheImage[rowStart + opp + 1];
-			TheImage[rowStart + col + 2] = TheImage[rowStart + opp + 2];
-
-			TheImage[rowStart + opp]     = pix.B;
-			TheImage[rowStart + opp + 1] = pix.G;
-			TheImage[rowStart + opp + 2] = pix.R;
-
-			col += 3;
-		}
+		memset((uch*)img + row * ip.Hbytes, 0, ip.Hbytes);
+		memset((uch*)img + (ip.Vpixels - row - 1) * ip.Hbytes, 0, ip.Hbytes);
 	}
-	pthread_exit(NULL);
+}
+
+// Runs in every pool worker before its first job
+void WorkerInit(int self, int nthreads)
+{
+	NumaPinThread(self, nthreads);		// no-op unless -n found several nodes
+	if(PerfOn) PerfOpenThread(self);
 }
 
 unsigned char *ReadBMPlin(char* fn)
@@ -165,7 +144,8 @@ unsigned char *ReadBMPlin(char* fn)
 	if (f == NULL){	printf("\n\n%s NOT FOUND\n\n", fn);	exit(EXIT_FAILURE); }
 
 	uch HeaderInfo[54];
-	fread(HeaderInfo, sizeof(uch), 54, f); // read the 54-byte header
+	size_t got = fread(HeaderInfo, sizeof(uch), 54, f); // read the 54-byte header
+	if (CheckBMPHeader(HeaderInfo, got, fn) != 0) exit(EXIT_FAILURE);
 	// extract image height and width from header
 	int width = *(int*)&HeaderInfo[18];			ip.Hpixels = width;
 	int height = *(int*)&HeaderInfo[22];		ip.Vpixels = height;
@@ -177,6 +157,8 @@ unsigned char *ReadBMPlin(char* fn)
 	// allocate memory to store the main image (1 Dimensional array)
 	Img  = (uch *)malloc(IMAGESIZE);
 	if (Img == NULL) return Img;      // Cannot allocate memory
+	// place every row pair on the node of the worker that will flip it
+	if (NumaNodes) PoolRun(MTTouch, Img, (IPV + 1) / 2);
 	// read the image from disk
 	fread(Img, sizeof(uch), IMAGESIZE, f);
 	fclose(f);
@@ -202,12 +184,34 @@ int main(int argc, char** argv)
 	struct timeval 		t;
 	double         		StartTime, EndTime;
 	double         		TimeElapsed;
+	long				StreamMB = 0;		// -s: memory budget of the streaming mode
+	int					Numa = 0;			// -n: NUMA placement and pinning
+	double				WorkerSecs;
+	long				WorkerItems;
+
+	while((a = getopt(argc, argv, "s:np")) != -1){
+		switch (a){
+			case 's': StreamMB = atol(optarg);		break;
+			case 'n': Numa = 1;						break;
+			case 'p': PerfOn = 1;					break;
+			default : printf("\n\nUsage: imflipP [-s MB] [-n] [-p] input output [v/h] [thread count]\n\n");
+			return 0;
+		}
+	}
+	// drop the options so argv[1] is the input file again
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	switch (argc){
 		case 3 : NumThreads=1; 				Flip = 'V';						break;
 		case 4 : NumThreads=1;  			Flip = toupper(argv[3][0]);		break;
 		case 5 : NumThreads=atoi(argv[4]);  Flip = toupper(argv[3][0]);		break;
-		default: printf("\n\nUsage: imflipP input output [v/h] [thread count]");
+		default: printf("\n\nUsage: imflipP [-s MB] [-n] [-p] input output [v/h] [thread count]");
+		printf("\n\n  -s MB  stream the file through MB megabytes of strips instead of loading it");
+		printf("\n  -n     NUMA mode: pin the threads to the nodes, place each row band on the");
+		printf("\n         node that flips it and report per-node bandwidth");
+		printf("\n  -p     read the hardware counters of every thread around the flips and");
+		printf("\n         report IPC and misses per pixel");
 		printf("\n\nExample: imflipP infilename.bmp outname.bmp h 8\n\n");
 		return 0;
 	}
@@ -239,27 +243,56 @@ int main(int argc, char** argv)
 		}
 	}
 
+	// pick the SIMD pixel reversal kernel once, before anything is timed
+	const char* RevKernel = InitPixelReverse();
+
+	if(StreamMB > 0){
+		if(Flip == 'G'){
+			printf("\nThe streaming mode only flips (V or H) ... Exiting abruptly ...\n");
+			exit(EXIT_FAILURE);
+		}
+		gettimeofday(&t, NULL);
+		StartTime = (double)t.tv_sec*1000000.0 + ((double)t.tv_usec);
+		if(StreamFlip(argv[1], argv[2], Flip, NumThreads, (size_t)StreamMB << 20) != 0){
+			printf("\nA %ld MB budget cannot hold one row of %s ... Exiting abruptly ...\n", StreamMB, argv[1]);
+			exit(EXIT_FAILURE);
+		}
+		gettimeofday(&t, NULL);
+		EndTime = (double)t.tv_sec*1000000.0 + ((double)t.tv_usec);
+		TimeElapsed=(EndTime-StartTime)/1000.00;
+
+		printf("\n\nStreaming time: %9.4f ms (%s)", TimeElapsed, Flip=='V'?"Vertical flip":"Horizontal flip");
+		printf(" (%6.3f ns/pixel)\n", 1000000*TimeElapsed/(double)(ip.Hpixels*ip.Vpixels));
+		printf("Disk throughput: %.1f MB/s\n", 2.0*IMAGESIZE/(TimeElapsed*1000.0));
+		printf("Pixel reversal kernel: %s\n", RevKernel);
+		return (EXIT_SUCCESS);
+	}
+
+	// the pool is started once, the reps only hand it work. It exists before
+	// the image does, so in NUMA mode its pinned workers can first touch it
+	if(NumThreads >1){
+		if(Numa && NumaInit() == 0) printf("\nSingle NUMA node, -n has no effect\n");
+		ThErr = PoolStart(NumThreads, WorkerInit);
+		if(ThErr != 0){
+			printf("\nThread Creation Error %d. Exiting abruptly... \n",ThErr);
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	TheImage = ReadBMPlin(argv[1]);
+	MTItems = (IPV + 1) / 2;
+	PoolResetStats();
+
+	// the serial flips run on this thread
+	if(PerfOn && NumThreads == 1) PerfOpenThread(0);
 
 	gettimeofday(&t, NULL);
 	StartTime = (double)t.tv_sec*1000000.0 + ((double)t.tv_usec);
+	if(PerfOn) PerfStart();
 
 	if(NumThreads >1){
-		pthread_attr_init(&ThAttr);
-		pthread_attr_setdetachstate(&ThAttr, PTHREAD_CREATE_JOINABLE);
 		for(a=0; a<REPS; a++){
-			for(i=0; i<NumThreads; i++){
-				ThParam[i] = i;
-				ThErr = pthread_create(&ThHandle[i], &ThAttr, MTFlipFunc, (void *)&ThParam[i]);
-				if(ThErr != 0){
-					printf("\nThread Creation Error %d. Exiting abruptly... \n",ThErr);
-					exit(EXIT_FAILURE);
-				}
-			}
-			pthread_attr_destroy(&ThAttr);
-			for(i=0; i<NumThreads; i++){
-				pthread_join(ThHandle[i], NULL);
-			}
+			PoolRun(MTFlipFunc, TheImage, MTItems);
 		}
 	}else{
 		for(a=0; a<REPS; a++){
@@ -267,11 +300,21 @@ int main(int argc, char** argv)
 		}
 	}
 
+	if(PerfOn) PerfStop();
 	gettimeofday(&t, NULL);
 	EndTime = (double)t.tv_sec*1000000.0 + ((double)t.tv_usec);
 	TimeElapsed=(EndTime-StartTime)/1000.00;
 	TimeElapsed/=(double)REPS;
 
+	if(NumThreads >1){
+		// a row pair is read and written once: 4 rows of traffic
+		for(i=0; i<NumThreads; i++){
+			PoolStats(i, &WorkerSecs, &WorkerItems);
+			NumaAddWork(i, WorkerSecs, 4.0 * WorkerItems * IPHB);
+		}
+		PoolStop();
+	}
+
 	//merge with header and write to file
 	WriteBMPlin(TheImage, argv[2]);
 
@@ -280,6 +323,13 @@ int main(int argc, char** argv)
 
 	printf("\n\nTotal execution time: %9.4f ms (%s)",TimeElapsed, Flip=='V'?"Vertical flip": (Flip == 'H'?"Horizontal flip":"Grayscale") );
 	printf(" (%6.3f ns/pixel)\n", 1000000*TimeElapsed/(double)(ip.Hpixels*ip.Vpixels));
+	printf("Pixel reversal kernel: %s\n", RevKernel);
+	NumaReport(NumThreads);
+	if(PerfOn){
+		PerfReport((double)IMAGEPIX * REPS, "pixel");
+		PerfClose();
+	}
+	printf("\n");
 
 	return (EXIT_SUCCESS);
 }
@@ -1,11 +1,19 @@
 #include <mpi.h>
+#include <omp.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include "ImageStuff.h"
+#include "PixelReverse.h"
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 typedef unsigned char uch;
 typedef unsigned long ul;
@@ -23,30 +31,40 @@ struct ImgProp ip;
 // To be shared across functions
 int rank, numProcs,localRows,rowsPerProc, localSize; 
 double sendrecvOH = 0, flipTime = 0; 
+int vflipMessages = 0; // blocks this rank sent in FlipImageV
+double readTime = 0, writeTime = 0; // file I/O, ms
+int numThreads = 1; // OpenMP threads per rank (-t)
+int quietIO = 0; // task farm: no line per file read or written
 
 //Overhead by sendrcv on Vflip
 
 // Read a 24-bit/pixel BMP file into a 1D linear array.
-// Allocate memory to store the 1D image and return its pointer.
+// Allocate memory to store the 1D image and return its pointer, or NULL after saying
+// why the file cannot be read; the caller decides whether that ends the run
 uch *ReadBMPlin(char* fn)
 {
 	static uch *Img;
 	FILE* f = fopen(fn, "rb");
-	if (f == NULL){	printf("\n\n%s NOT FOUND\n\n", fn);	exit(EXIT_FAILURE); }
+	if (f == NULL){	printf("\n\n%s NOT FOUND\n\n", fn);	return NULL; }
 
 	uch HeaderInfo[54];
-	fread(HeaderInfo, sizeof(uch), 54, f); // read the 54-byte header
+	size_t got = fread(HeaderInfo, sizeof(uch), 54, f); // read the 54-byte header
+	if (CheckBMPHeader(HeaderInfo, got, fn) != 0) { fclose(f); return NULL; }
 	// extract image height and width from header
 	int width = *(int*)&HeaderInfo[18];			ip.Hpixels = width;
 	int height = *(int*)&HeaderInfo[22];		ip.Vpixels = height;
 	int RowBytes = (width * 3 + 3) & (~3);		ip.Hbytes = RowBytes;
 	//save header for re-use
 	memcpy(ip.HeaderInfo, HeaderInfo,54);
-	printf("\n Input File name: %17s  (%u x %u)   File Size=%lu", fn, 
+	if (!quietIO) printf("\n Input File name: %17s  (%u x %u)   File Size=%lu", fn, 
 			ip.Hpixels, ip.Vpixels, IMAGESIZE);
 	// allocate memory to store the main image (1 Dimensional array)
 	Img  = (uch *)malloc(IMAGESIZE);
-	if (Img == NULL) return Img;      // Cannot allocate memory
+	if (Img == NULL) {      // Cannot allocate memory
+		printf("\n\nCannot allocate %s\n\n", fn);
+		fclose(f);
+		return Img;
+	}
 	// read the image from disk
 	fread(Img, sizeof(uch), IMAGESIZE, f);
 	fclose(f);
@@ -61,150 +79,925 @@ void WriteBMPlin(uch *Img, char* fn)
 	fwrite(ip.HeaderInfo, sizeof(uch), 54, f);
 	//write data
 	fwrite(Img, sizeof(uch), IMAGESIZE, f);
-	printf("\nOutput File name: %17s  (%u x %u)   File Size=%lu\n\n", fn, ip.Hpixels, ip.Vpixels, IMAGESIZE);
+	if (!quietIO) printf("\nOutput File name: %17s  (%u x %u)   File Size=%lu\n\n", fn, ip.Hpixels, ip.Vpixels, IMAGESIZE);
 	fclose(f);
 }
+// Swaps two rows through a small stack buffer, so every OpenMP thread can swap its own
+#define SWAP_CHUNK 4096
+void SwapRows(uch *a, uch *b, size_t rowSize) {
+    uch Buff[SWAP_CHUNK];
+    size_t off, len;
+    for (off = 0; off < rowSize; off += len) {
+        len = (rowSize - off < SWAP_CHUNK) ? rowSize - off : SWAP_CHUNK;
+        memcpy(Buff, a + off, len);
+        memcpy(a + off, b + off, len);
+        memcpy(b + off, Buff, len);
+    }
+}
+
 // Flips image horizontally, swaps pixels on local rows
-// No coordination required!
-void FlipImageH(unsigned char* img) {
-    int row, col;
-    struct Pixel pix;
-	int mid = ip.Hpixels * 3 / 2; // Middle of the rows
-    for (row = 0; row < localRows; row++) {
-        int rowStart = row * ip.Hbytes;
-        for (col = 0; col < mid; col += 3) {
-            int left = rowStart + col;
-            int right = rowStart + ip.Hpixels * 3 - (col + 3);
-
-            pix.B = img[left	];
-            pix.G = img[left + 1];
-            pix.R = img[left + 2];
-
-            img[left	] = img[right	 ];
-            img[left + 1] = img[right + 1];
-            img[left + 2] = img[right + 2];
-
-            img[right	 ] = pix.B;
-            img[right + 1] = pix.G;
-            img[right + 2] = pix.R;
-        }
+// No coordination required! The rows are split over the rank's OpenMP threads
+void FlipImageH(unsigned char* img, int rows) {
+    int row;
+#pragma omp parallel for schedule(static)
+    for (row = 0; row < rows; row++) {
+        ReverseRow24(img + (size_t)row * ip.Hbytes, ip.Hpixels);
     }
 }
 
 /*Vertical flipping functions*/
 
-// Helper function to find the rank owning a global row
-int getRank(int globalRow) {
-    if (numProcs == 1) return 0;
-    int lastProcStartRow = (numProcs - 1) * rowsPerProc;
-    return (globalRow < lastProcStartRow) ? globalRow / rowsPerProc : numProcs - 1;
-}
-// Helper function to find the local index within the owner process
-int getMyIdx(int globalRow) {
-    if (numProcs == 1) return globalRow; 
-    return globalRow - rank * rowsPerProc;
+// Global rows [*first, *first + *count) owned by rank r, the last rank takes the remainder
+void rankRows(int r, int *first, int *count) {
+    *first = r * rowsPerProc;
+    *count = (r == numProcs - 1) ? ip.Vpixels - *first : rowsPerProc;
 }
 
 // Flips Image Vertically , Swaps whole rows
-// Each process iterates through half the image, even though they only own a portion
-// Requires Coordination between procs !
+// The mirrors of this rank's rows form one contiguous range of global rows, owned by a
+// few neighbouring ranks (more than two only when the last rank holds a large remainder).
+// Each overlap with another rank is exchanged as one block, rows in stored order, and
+// the receiver lays them down in reverse. Rows that mirror onto this rank are swapped
+// locally while the blocks are in flight. O(ranks) messages instead of O(rows)
 void FlipImageV(unsigned char *img) {
-    int rowSize = ip.Hbytes;
-    int halfRows = ip.Vpixels / 2;
-    int topOwner, bottomOwner, partnerRank; // Ranks 
-    int globalRowIdx, localRowIdx, topLocalIdx, bottomLocalIdx, bottomGlobalIdx; // Indeces
-    double start_time, end_time, elapsed_time;
-    size_t Offset;
+    size_t rowSize = ip.Hbytes;
+    int myFirst, myCount, first, count, lo, hi, q, k, n = 0;
+    int mirLo, mirHi, selfLo = 1, selfHi = 0; // mirror range of my rows, inclusive
+    double start_time;
+    uch *recvBuf;
+
+    rankRows(rank, &myFirst, &myCount);
+    mirLo = ip.Vpixels - (myFirst + myCount);
+    mirHi = ip.Vpixels - 1 - myFirst;
+
+    // the received blocks add up to at most my own rows
+    recvBuf = (uch *)malloc(localSize > 0 ? localSize : 1);
+    int *blockLo = (int *)malloc(numProcs * sizeof(int));
+    int *blockRows = (int *)malloc(numProcs * sizeof(int));
+    MPI_Request *reqs = (MPI_Request *)malloc(2 * numProcs * sizeof(MPI_Request));
+    if (!recvBuf || !blockLo || !blockRows || !reqs) {
+        printf("Rank %d: Failed to allocate the exchange buffers\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return;
+    }
+
+    start_time = MPI_Wtime();
+    size_t recvOff = 0;
+    for (q = 0; q < numProcs; q++) {
+        rankRows(q, &first, &count);
+        lo = (first > mirLo) ? first : mirLo;
+        hi = (first + count - 1 < mirHi) ? first + count - 1 : mirHi;
+        if (lo > hi) continue; // no overlap
+        if (q == rank) {
+            selfLo = lo;
+            selfHi = hi;
+            continue;
+        }
+        // q's rows [lo, hi] mirror onto my rows [V-1-hi, V-1-lo], which go the other way
+        blockLo[n] = lo;
+        blockRows[n] = hi - lo + 1;
+        MPI_Irecv(recvBuf + recvOff, blockRows[n] * rowSize, MPI_UNSIGNED_CHAR, q, 0,
+                  MPI_COMM_WORLD, &reqs[2 * n]);
+        MPI_Isend(img + (size_t)(ip.Vpixels - 1 - hi - myFirst) * rowSize,
+                  blockRows[n] * rowSize, MPI_UNSIGNED_CHAR, q, 0, MPI_COMM_WORLD,
+                  &reqs[2 * n + 1]);
+        recvOff += (size_t)blockRows[n] * rowSize;
+        n++;
+    }
+    sendrecvOH += (MPI_Wtime() - start_time) * 1000;
+
+    // Local swap, no comm: these rows are disjoint from the ones being sent.
+    // Only the main thread talks to MPI (MPI_THREAD_FUNNELED), the threads just copy
+    if (selfHi > ip.Vpixels / 2 - 1) selfHi = ip.Vpixels / 2 - 1; // up to the middle
+#pragma omp parallel for schedule(static)
+    for (k = selfLo; k <= selfHi; k++) {
+        SwapRows(img + (size_t)(k - myFirst) * rowSize,
+                 img + (size_t)(ip.Vpixels - 1 - k - myFirst) * rowSize, rowSize);
+    }
+
+    start_time = MPI_Wtime();
+    MPI_Waitall(2 * n, reqs, MPI_STATUSES_IGNORE);
+    sendrecvOH += (MPI_Wtime() - start_time) * 1000;
+    vflipMessages += n;
+
+    // Received row lo+k lands on global row V-1-lo-k
+    recvOff = 0;
+    for (q = 0; q < n; q++) {
+        uch *block = recvBuf + recvOff;
+        int lo = blockLo[q];
+#pragma omp parallel for schedule(static)
+        for (k = 0; k < blockRows[q]; k++) {
+            memcpy(img + (size_t)(ip.Vpixels - 1 - lo - k - myFirst) * rowSize,
+                   block + (size_t)k * rowSize, rowSize);
+        }
+        recvOff += (size_t)blockRows[q] * rowSize;
+    }
+
+    free(reqs);
+    free(blockRows);
+    free(blockLo);
+    free(recvBuf);
+}
+
+// Same as FlipImageV for MPI-IO and pipelined modes: the rows only swap places within
+// the rank, the file offset or gather displacement they go to does the rest
+void ReverseLocalRows(unsigned char *img, int rows) {
+    size_t rowSize = ip.Hbytes;
+    int row;
+
+#pragma omp parallel for schedule(static)
+    for (row = 0; row < rows / 2; row++) {
+        SwapRows(img + (size_t)row * rowSize, img + (size_t)(rows - 1 - row) * rowSize,
+                 rowSize);
+    }
+}
+
+// How the rows are distributed, once ip is known on every rank
+void PartitionRows() {
+    int first;
+    rowsPerProc = ip.Vpixels / numProcs;
+    rankRows(rank, &first, &localRows);
+    localSize = localRows * ip.Hbytes; //Size of the image portion each rank handles
+}
+
+/*Distributed rotations: C (90 degrees clockwise), A (counter-clockwise), T (transpose)*/
+
+#define ROT_TILE 32 // pixels
+
+// Alltoallv counts and displacements are ints; a block past that cannot be sent
+int PixelCount(size_t pixels) {
+    if (pixels > INT_MAX) {
+        printf("Rank %d: a rotation block of %zu pixels exceeds an MPI count\n", rank, pixels);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return (int)pixels;
+}
+
+// Makes ip and the header describe a width x height image, e.g. after a rotation
+void SetImageSize(int width, int height) {
+    ip.Hpixels = width;
+    ip.Vpixels = height;
+    ip.Hbytes = (width * 3 + 3) & (~3);
+    *(int*)&ip.HeaderInfo[18] = width;
+    *(int*)&ip.HeaderInfo[22] = height;
+    *(unsigned int*)&ip.HeaderInfo[34] = ip.Hbytes * height;
+    *(unsigned int*)&ip.HeaderInfo[2] = 54 + ip.Hbytes * height;
+}
+
+// Rotates the row-partitioned image. Destination pixel (row y, column x) comes from
+// source row x or V-1-x, column y or W-1-y, as in the OpenMP rotation engine, so my
+// source rows become one block of destination columns spread over every rank. Each rank
+// transposes its rows tile by tile into a W x localRows pixel buffer, which is already
+// ordered by destination rank, and a single MPI_Alltoallv delivers the blocks. Then ip
+// describes the rotated image, its W rows are re-partitioned over the ranks and the
+// received blocks are laid side by side. The blocks are counted in 3-byte pixels, not
+// bytes, to keep the int counts of larger frames in range. Frees img and returns the
+// new local rows; *bytesSent gets what this rank sent to the other ranks
+uch *RotateDistributed(uch *img, char Flip, double *bytesSent) {
+    int W = ip.Hpixels, V = ip.Vpixels;
+    int mirrorRow = (Flip == 'A' || Flip == 'T'), mirrorCol = (Flip == 'C' || Flip == 'T');
+    int myFirst, myCount, first, count, q, r;
+    size_t srcHbytes = ip.Hbytes;
+    long tilesX, tilesY, t;
+    double start;
+    uch *sendBuf, *recvBuf, *dst;
+    MPI_Datatype pixelType;
+
+    rankRows(rank, &myFirst, &myCount);
+    int myDstFirst = rank * (W / numProcs);
+    int myDstRows = (rank == numProcs - 1) ? W - myDstFirst : W / numProcs;
+    int *sendcounts = (int *)malloc(4 * numProcs * sizeof(int));
+    sendBuf = (uch *)malloc((size_t)W * myCount * 3 + 1);
+    recvBuf = (uch *)malloc((size_t)myDstRows * V * 3 + 1);
+    if (!sendcounts || !sendBuf || !recvBuf) {
+        printf("Rank %d: Failed to allocate the rotation buffers\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int *sdispls = sendcounts + numProcs, *recvcounts = sdispls + numProcs;
+    int *rdispls = recvcounts + numProcs;
+
+    // rank q gets destination rows [q*(W/P), ...), i.e. the same rows of my buffer;
+    // rank q's source rows arrive as myDstRows rows of its count pixels
+    *bytesSent = 0;
+    for (q = 0; q < numProcs; q++) {
+        first = q * (W / numProcs);
+        count = (q == numProcs - 1) ? W - first : W / numProcs;
+        sendcounts[q] = PixelCount((size_t)count * myCount);
+        sdispls[q] = PixelCount((size_t)first * myCount);
+        if (q != rank) *bytesSent += 3.0 * sendcounts[q];
+        rankRows(q, &first, &count);
+        recvcounts[q] = PixelCount((size_t)myDstRows * count);
+        rdispls[q] = PixelCount((size_t)myDstRows * first);
+    }
+
+    // buffer row y, column x: destination row y, column x of my block of columns
+    tilesX = (myCount + ROT_TILE - 1) / ROT_TILE;
+    tilesY = (W + ROT_TILE - 1) / ROT_TILE;
+#pragma omp parallel for schedule(static)
+    for (t = 0; t < tilesX * tilesY; t++) {
+        int x0 = (t % tilesX) * ROT_TILE, y0 = (t / tilesX) * ROT_TILE;
+        int x1 = (x0 + ROT_TILE < myCount) ? x0 + ROT_TILE : myCount;
+        int y1 = (y0 + ROT_TILE < W) ? y0 + ROT_TILE : W;
+        int x, y, sx;
+        struct Pixel *d;
+
+        for (y = y0; y < y1; y++) {
+            sx = mirrorCol ? W - (y + 1) : y;
+            d = (struct Pixel *)(sendBuf + (size_t)y * myCount * 3);
+            for (x = x0; x < x1; x++) {
+                int row = mirrorRow ? myCount - (x + 1) : x; // my source row of column x
+                d[x] = ((struct Pixel *)(img + (size_t)row * srcHbytes))[sx];
+            }
+        }
+    }
+
+    MPI_Type_contiguous(3, MPI_UNSIGNED_CHAR, &pixelType);
+    MPI_Type_commit(&pixelType);
+    start = MPI_Wtime();
+    MPI_Alltoallv(sendBuf, sendcounts, sdispls, pixelType, recvBuf, recvcounts, rdispls,
+                  pixelType, MPI_COMM_WORLD);
+    sendrecvOH += (MPI_Wtime() - start) * 1000;
+    MPI_Type_free(&pixelType);
+    free(sendBuf);
+    free(img);
+
+    SetImageSize(V, W);
+    PartitionRows();
+    dst = (uch *)malloc(localSize > 0 ? localSize : 1);
+    if (!dst) {
+        printf("Rank %d: Failed to allocate the rotated rows\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // rank q's block covers destination columns [colLo, colLo + count) of every row
+#pragma omp parallel for schedule(static) private(q)
+    for (r = 0; r < myDstRows; r++) {
+        uch *row = dst + (size_t)r * ip.Hbytes;
+        for (q = 0; q < numProcs; q++) {
+            // the source partition: rankRows() follows the rotated ip already
+            int qFirst = q * (V / numProcs), qCount, colLo;
+            qCount = (q == numProcs - 1) ? V - qFirst : V / numProcs;
+            colLo = mirrorRow ? V - (qFirst + qCount) : qFirst;
+            memcpy(row + (size_t)colLo * 3, recvBuf + ((size_t)rdispls[q] + (size_t)r * qCount) * 3,
+                   (size_t)qCount * 3);
+        }
+        memset(row + (size_t)V * 3, 0, ip.Hbytes - (size_t)V * 3);
+    }
+    free(recvBuf);
+    free(sendcounts);
+    return dst;
+}
+
+/*Pipelined mode: chunks in flight while others are flipped*/
+
+// Every rank's rows go out and come back in K chunks through non-blocking collectives,
+// all scatters posted up front, so chunk c+1 arrives while chunk c is flipped and chunk
+// c-1 is gathered. V needs no exchange here: a chunk is reversed in place and rank 0
+// gathers it at its mirrored rows, which is why 'out' must not be 'img'.
+// Returns the wall time in ms, *waitTime gets the time blocked on communication
+double PipelinedFlip(uch *img, uch *out, uch *localImage, char Flip, int K, double *waitTime) {
+    size_t rowSize = ip.Hbytes;
+    int c, q, first, count, cf, cn;
+    int *counts = NULL, *displs = NULL, *gdispls = NULL;
+    double start, t;
+    MPI_Request *scatterReqs = (MPI_Request *)malloc(K * sizeof(MPI_Request));
+    MPI_Request *gatherReqs = (MPI_Request *)malloc(K * sizeof(MPI_Request));
+
+    if (!scatterReqs || !gatherReqs) {
+        printf("Rank %d: Failed to allocate the chunk requests\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (rank == 0) {
+        // chunk c of every rank, in bytes: where it comes from and where it goes back
+        counts = (int *)malloc(K * numProcs * sizeof(int));
+        displs = (int *)malloc(K * numProcs * sizeof(int));
+        gdispls = (int *)malloc(K * numProcs * sizeof(int));
+        if (!counts || !displs || !gdispls) {
+            printf("Rank 0: Failed to allocate the chunk tables\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        for (c = 0; c < K; c++) {
+            for (q = 0; q < numProcs; q++) {
+                rankRows(q, &first, &count);
+                cf = first + (int)((long)count * c / K);
+                cn = first + (int)((long)count * (c + 1) / K) - cf;
+                counts[c * numProcs + q] = cn * ip.Hbytes;
+                displs[c * numProcs + q] = cf * ip.Hbytes;
+                gdispls[c * numProcs + q] = (Flip == 'V' ? ip.Vpixels - cf - cn : cf) * ip.Hbytes;
+            }
+        }
+    }
+
+    *waitTime = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    for (c = 0; c < K; c++) {
+        cf = (int)((long)localRows * c / K);
+        cn = (int)((long)localRows * (c + 1) / K) - cf;
+        MPI_Iscatterv(img, counts ? counts + c * numProcs : NULL,
+                      displs ? displs + c * numProcs : NULL, MPI_UNSIGNED_CHAR,
+                      localImage + cf * rowSize, cn * rowSize, MPI_UNSIGNED_CHAR, 0,
+                      MPI_COMM_WORLD, &scatterReqs[c]);
+    }
+    for (c = 0; c < K; c++) {
+        cf = (int)((long)localRows * c / K);
+        cn = (int)((long)localRows * (c + 1) / K) - cf;
+        t = MPI_Wtime();
+        MPI_Wait(&scatterReqs[c], MPI_STATUS_IGNORE);
+        *waitTime += (MPI_Wtime() - t) * 1000;
+
+        if (Flip == 'V') ReverseLocalRows(localImage + cf * rowSize, cn);
+        else FlipImageH(localImage + cf * rowSize, cn);
+
+        MPI_Igatherv(localImage + cf * rowSize, cn * rowSize, MPI_UNSIGNED_CHAR, out,
+                     counts ? counts + c * numProcs : NULL,
+                     gdispls ? gdispls + c * numProcs : NULL, MPI_UNSIGNED_CHAR, 0,
+                     MPI_COMM_WORLD, &gatherReqs[c]);
+    }
+    t = MPI_Wtime();
+    MPI_Waitall(K, gatherReqs, MPI_STATUSES_IGNORE);
+    *waitTime += (MPI_Wtime() - t) * 1000;
+    t = (MPI_Wtime() - start) * 1000;
+
+    free(gdispls);
+    free(displs);
+    free(counts);
+    free(gatherReqs);
+    free(scatterReqs);
+    return t;
+}
+
+/*Shared-window mode: one copy of the image per node*/
+
+// The ranks of a node flip their share of the node's rows in place, in a window
+// allocated once per node with MPI_Win_allocate_shared; only the node leaders move
+// pixels, one Scatterv in and one Gatherv out over the leaders' communicator. V needs
+// no exchange: the node reverses its rows and rank 0 gathers them at the mirrored rows.
+// *scatterTime and *gatherTime get the leader traffic in ms, *nodes the node count
+void SharedWindowFlip(char Flip, double *scatterTime, double *gatherTime, int *nodes) {
+    MPI_Comm nodeComm, leaderComm = MPI_COMM_NULL;
+    MPI_Win win;
+    MPI_Aint winBytes;
+    size_t rowSize = ip.Hbytes;
+    int nodeRank, nodeSize, node, nodeFirst, nodeRows, dispUnit, q, first, count;
+    int *counts = NULL, *displs = NULL, *gdispls = NULL;
+    double start;
+    uch *base;
+
+    // ranks that can share memory, world rank 0 is the leader of its node
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    MPI_Comm_size(nodeComm, &nodeSize);
+    MPI_Comm_split(MPI_COMM_WORLD, nodeRank == 0 ? 0 : MPI_UNDEFINED, rank, &leaderComm);
+    if (nodeRank == 0) {
+        MPI_Comm_rank(leaderComm, &node);
+        MPI_Comm_size(leaderComm, nodes);
+    }
+    MPI_Bcast(&node, 1, MPI_INT, 0, nodeComm);
+    MPI_Bcast(nodes, 1, MPI_INT, 0, nodeComm);
+
+    // the rows are split over the nodes as rankRows() splits them over the ranks
+    nodeFirst = node * (ip.Vpixels / *nodes);
+    nodeRows = (node == *nodes - 1) ? ip.Vpixels - nodeFirst : ip.Vpixels / *nodes;
+    MPI_Win_allocate_shared(nodeRank == 0 ? (MPI_Aint)nodeRows * rowSize : 0, 1,
+                            MPI_INFO_NULL, nodeComm, &base, &win);
+    MPI_Win_shared_query(win, 0, &winBytes, &dispUnit, &base);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win); // passive target, load/store only
+
+    if (rank == 0) {
+        counts = (int *)malloc(*nodes * sizeof(int));
+        displs = (int *)malloc(*nodes * sizeof(int));
+        gdispls = (int *)malloc(*nodes * sizeof(int));
+        if (!counts || !displs || !gdispls) {
+            printf("Rank 0: Failed to allocate the node tables\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        for (q = 0; q < *nodes; q++) {
+            first = q * (ip.Vpixels / *nodes);
+            count = (q == *nodes - 1) ? ip.Vpixels - first : ip.Vpixels / *nodes;
+            counts[q] = count * ip.Hbytes;
+            displs[q] = first * ip.Hbytes;
+            gdispls[q] = (Flip == 'V' ? ip.Vpixels - first - count : first) * ip.Hbytes;
+        }
+    }
+
+    start = MPI_Wtime();
+    if (nodeRank == 0)
+        MPI_Scatterv(TheImage, counts, displs, MPI_UNSIGNED_CHAR, base, nodeRows * rowSize,
+                     MPI_UNSIGNED_CHAR, 0, leaderComm);
+    *scatterTime = (MPI_Wtime() - start) * 1000;
+
+    // the leader's stores become visible to the node, then everyone flips
+    start = MPI_Wtime();
+    MPI_Win_sync(win);
+    MPI_Barrier(nodeComm);
+    MPI_Win_sync(win);
+    if (Flip == 'V') {
+        // my share of the node's row pairs
+        int pairs = nodeRows / 2, k;
+        first = (int)((long)pairs * nodeRank / nodeSize);
+        count = (int)((long)pairs * (nodeRank + 1) / nodeSize) - first;
+#pragma omp parallel for schedule(static)
+        for (k = first; k < first + count; k++) {
+            SwapRows(base + (size_t)k * rowSize, base + (size_t)(nodeRows - 1 - k) * rowSize,
+                     rowSize);
+        }
+    } else {
+        first = (int)((long)nodeRows * nodeRank / nodeSize);
+        count = (int)((long)nodeRows * (nodeRank + 1) / nodeSize) - first;
+        FlipImageH(base + (size_t)first * rowSize, count);
+    }
+    MPI_Win_sync(win);
+    MPI_Barrier(nodeComm);
+    MPI_Win_sync(win);
+    flipTime = (MPI_Wtime() - start) * 1000;
+
+    start = MPI_Wtime();
+    if (nodeRank == 0)
+        MPI_Gatherv(base, nodeRows * rowSize, MPI_UNSIGNED_CHAR, TheImage, counts, gdispls,
+                    MPI_UNSIGNED_CHAR, 0, leaderComm);
+    *gatherTime = (MPI_Wtime() - start) * 1000;
+
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+    if (leaderComm != MPI_COMM_NULL) MPI_Comm_free(&leaderComm);
+    MPI_Comm_free(&nodeComm);
+    free(gdispls);
+    free(displs);
+    free(counts);
+}
+
+// Bytes of every rank's rows in the whole image, for Scatterv/Gatherv
+void RowCounts(int *counts, int *displs) {
+    int q, first, count;
+    for (q = 0; q < numProcs; q++) {
+        rankRows(q, &first, &count);
+        counts[q] = count * ip.Hbytes;
+        displs[q] = first * ip.Hbytes;
+    }
+}
+
+/*MPI-IO mode: no rank holds the whole image*/
+
+// Rank 0 reads the 54-byte header and broadcasts it, then every rank reads its own
+// rows with one collective read. Returns the local rows, *bcastTime gets the header
+// broadcast in ms
+uch *ReadRowsMPIIO(char *fn, double *bcastTime) {
+    MPI_File fh;
+    double start;
+    int first, count, got = 0, bad = 0;
+    MPI_Status st;
+    uch *rows;
+
+    start = MPI_Wtime();
+    if (MPI_File_open(MPI_COMM_WORLD, fn, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) printf("\n\n%s NOT FOUND\n\n", fn);
+        MPI_Finalize();
+        exit(EXIT_FAILURE);
+    }
+    if (rank == 0) {
+        MPI_File_read_at(fh, 0, ip.HeaderInfo, 54, MPI_BYTE, &st);
+        MPI_Get_count(&st, MPI_BYTE, &got);
+        bad = CheckBMPHeader(ip.HeaderInfo, got, fn);
+    }
+    readTime += (MPI_Wtime() - start) * 1000;
+
+    start = MPI_Wtime();
+    MPI_Bcast(ip.HeaderInfo, 54, MPI_BYTE, 0, MPI_COMM_WORLD);
+    *bcastTime = (MPI_Wtime() - start) * 1000;
+    MPI_Bcast(&bad, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (bad) {
+        MPI_File_close(&fh);
+        MPI_Finalize();
+        exit(EXIT_FAILURE);
+    }
+    ip.Hpixels = *(int*)&ip.HeaderInfo[18];
+    ip.Vpixels = *(int*)&ip.HeaderInfo[22];
+    ip.Hbytes = (ip.Hpixels * 3 + 3) & (~3);
+    PartitionRows();
+    if (rank == 0)
+        printf("\n Input File name: %17s  (%u x %u)   File Size=%lu", fn,
+               ip.Hpixels, ip.Vpixels, IMAGESIZE);
 
-    uch *Buff = (uch *)malloc(rowSize);
+    rows = (uch *)malloc(localSize > 0 ? localSize : 1);
+    if (rows == NULL) {
+        fprintf(stderr, "Memory allocation failed on rank %d\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    start = MPI_Wtime();
+    rankRows(rank, &first, &count);
+    MPI_File_read_at_all(fh, 54 + (MPI_Offset)first * ip.Hbytes, rows, localSize,
+                         MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    readTime += (MPI_Wtime() - start) * 1000;
+    return rows;
+}
+
+// Every rank writes its rows, starting at global row firstRow, with one collective
+// write; rank 0 adds the header
+void WriteRowsMPIIO(uch *rows, char *fn, int firstRow) {
+    MPI_File fh;
+    double start = MPI_Wtime();
 
-    if (!Buff) {
-        printf("Rank %d: Failed to allocate row buffer\n", rank);
+    if (MPI_File_open(MPI_COMM_WORLD, fn, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                      &fh) != MPI_SUCCESS) {
+        if (rank == 0) printf("\n\nFILE CREATION ERROR: %s\n\n", fn);
         MPI_Abort(MPI_COMM_WORLD, 1);
-        return; 
     }
+    MPI_File_set_size(fh, 54 + (MPI_Offset)IMAGESIZE); // drops the tail of an older file
+    if (rank == 0) MPI_File_write_at(fh, 0, ip.HeaderInfo, 54, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(fh, 54 + (MPI_Offset)firstRow * ip.Hbytes, rows, localSize,
+                          MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    writeTime += (MPI_Wtime() - start) * 1000;
+    if (rank == 0)
+        printf("\nOutput File name: %17s  (%u x %u)   File Size=%lu\n\n", fn, ip.Hpixels, ip.Vpixels, IMAGESIZE);
+}
+
+/*Task farm: many images, one rank per image*/
+
+#define TAG_READY 1 // worker -> master: send me work
+#define TAG_WORK  2 // master -> worker: newline separated file names
+#define TAG_STOP  3 // master -> worker: nothing left
+
+enum { FARM_IMAGES, FARM_BUSY, FARM_IDLE, FARM_BYTES, FARM_FAILED, FARM_STATS };
+
+char **FarmInputs;
+int FarmCount;
+
+void AddFarmInput(const char *path, int *cap) {
+    if (FarmCount == *cap) {
+        *cap = *cap ? 2 * *cap : 64;
+        FarmInputs = (char **)realloc(FarmInputs, *cap * sizeof(char *));
+        if (FarmInputs == NULL) {
+            printf("\n\nCannot allocate the image list\n\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    FarmInputs[FarmCount++] = strdup(path);
+}
+
+int CompareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
 
-    for (int i = 0; i < halfRows; ++i) { // Iterate trough half of global image
-        bottomGlobalIdx = ip.Vpixels - 1 - i; // Opposite idx
-        topOwner = getRank(i);
-        bottomOwner = getRank(bottomGlobalIdx);
+const char *BaseName(const char *path) {
+    const char *base = strrchr(path, '/');
+    return base ? base + 1 : path;
+}
+
+int CompareBaseNames(const void *a, const void *b) {
+    return strcmp(BaseName(*(char *const *)a), BaseName(*(char *const *)b));
+}
+
+// The outputs take the inputs' file names, so two list entries with the same file name,
+// e.g. a/x.bmp and b/x.bmp, would overwrite each other
+int CheckFarmNames() {
+    char **sorted = (char **)malloc((FarmCount + 1) * sizeof(char *));
+    int i, dup = 0;
+
+    if (sorted == NULL) {
+        printf("\n\nCannot allocate the image list\n\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    memcpy(sorted, FarmInputs, FarmCount * sizeof(char *));
+    qsort(sorted, FarmCount, sizeof(char *), CompareBaseNames);
+    for (i = 1; i < FarmCount && !dup; i++) {
+        if (strcmp(BaseName(sorted[i - 1]), BaseName(sorted[i])) == 0) {
+            printf("\n\n%s and %s would both be written as %s\n\n", sorted[i - 1], sorted[i],
+                   BaseName(sorted[i]));
+            dup = 1;
+        }
+    }
+    free(sorted);
+    return dup ? -1 : 0;
+}
 
-        if (topOwner == bottomOwner) { // Local Swap, no comm
-            if (rank == topOwner) {
-                topLocalIdx = getMyIdx(i);
-                bottomLocalIdx = getMyIdx(bottomGlobalIdx);
+// Fills FarmInputs with the *.bmp files of a directory, or the lines of a list file,
+// whose entries must have distinct file names
+int ListFarmInputs(char *input) {
+    char path[4096];
+    struct dirent *e;
+    size_t len;
+    int cap = 0;
+    DIR *dir = opendir(input);
+    FILE *f;
 
-                memcpy(Buff, img + (size_t)topLocalIdx * rowSize, rowSize);
-                memcpy(img + (size_t)topLocalIdx * rowSize, img + (size_t)bottomLocalIdx * rowSize, rowSize);
-                memcpy(img + (size_t)bottomLocalIdx * rowSize, Buff, rowSize);
+    if (dir != NULL) {
+        while ((e = readdir(dir)) != NULL) {
+            len = strlen(e->d_name);
+            if (len > 4 && strcasecmp(e->d_name + len - 4, ".bmp") == 0) {
+                snprintf(path, sizeof(path), "%s/%s", input, e->d_name);
+                AddFarmInput(path, &cap);
             }
-        } else { // Swap involves 2 procs, comm required
-            if (rank == topOwner) { //Determine sendrcv params, based on role
-                partnerRank = bottomOwner;
-                globalRowIdx = i;
-            } else if (rank == bottomOwner) {
-                partnerRank = topOwner;
-                globalRowIdx = bottomGlobalIdx;
+        }
+        closedir(dir);
+        qsort(FarmInputs, FarmCount, sizeof(char *), CompareNames);
+        return 0;
+    }
+    if ((f = fopen(input, "r")) == NULL) return -1;
+    while (fgets(path, sizeof(path), f) != NULL) {
+        path[strcspn(path, "\r\n")] = '\0';
+        if (path[0] != '\0') AddFarmInput(path, &cap);
+    }
+    fclose(f);
+    return CheckFarmNames();
+}
+
+// Reads, flips and writes one image on this rank alone and adds it to stats (images,
+// bytes, failed); an image that cannot be read is skipped, the farm goes on
+void FarmImage(char *in, char *outDir, char Flip, double *stats) {
+    char out[4096];
+    uch *img = ReadBMPlin(in);
+
+    if (img == NULL) {
+        printf("Rank %d: skipping %s\n", rank, in);
+        stats[FARM_FAILED]++;
+        return;
+    }
+    if (Flip == 'V') ReverseLocalRows(img, ip.Vpixels);
+    else FlipImageH(img, ip.Vpixels);
+    snprintf(out, sizeof(out), "%s/%s", outDir, BaseName(in));
+    WriteBMPlin(img, out);
+    free(img);
+    stats[FARM_IMAGES]++;
+    stats[FARM_BYTES] += (double)IMAGESIZE;
+}
+
+// Rank 0 hands out 'batch' file names per request until none are left; every other
+// rank asks for work, then reads, flips and writes those images with the local kernels,
+// so faster ranks and smaller images simply take more requests. With a single rank,
+// rank 0 does all the images itself. Prints per-rank images, skipped images, busy and
+// idle time and the aggregate throughput
+void RunTaskFarm(char *input, char *outDir, char Flip, int batch) {
+    double stats[FARM_STATS] = { 0 }; // images, busy ms, idle ms, bytes, failed
+    double *all = NULL, start, t, elapsed;
+    char *names = NULL;
+    int i, len, stopped = 0, next = 0, dummy = 0, ok = 1;
+    MPI_Status st;
+
+    quietIO = 1;
+    if (rank == 0) {
+        if (ListFarmInputs(input) != 0) {
+            printf("\n\nCannot build the image list from %s\n\n", input);
+            ok = 0;
+        } else if (mkdir(outDir, 0755) != 0 && errno != EEXIST) {
+            printf("\n\nCannot create the output directory %s\n\n", outDir);
+            ok = 0;
+        } else {
+            printf("\nTask farm of %d images: %d worker rank(s), %d image(s) per request\n",
+                   FarmCount, numProcs > 1 ? numProcs - 1 : 1, batch);
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) {
+        MPI_Finalize();
+        exit(EXIT_FAILURE);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    if (rank == 0 && numProcs == 1) {
+        for (i = 0; i < FarmCount; i++) FarmImage(FarmInputs[i], outDir, Flip, stats);
+        stats[FARM_BUSY] = (MPI_Wtime() - start) * 1000;
+    } else if (rank == 0) {
+        // master: answer every request with the next batch, or a stop once all are out
+        names = (char *)malloc((size_t)batch * 4096 + 1);
+        if (names == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+        while (stopped < numProcs - 1) {
+            MPI_Recv(&dummy, 1, MPI_INT, MPI_ANY_SOURCE, TAG_READY, MPI_COMM_WORLD, &st);
+            for (len = 0, i = 0; i < batch && next < FarmCount; i++, next++)
+                len += sprintf(names + len, "%s\n", FarmInputs[next]);
+            if (len > 0) {
+                MPI_Send(names, len + 1, MPI_CHAR, st.MPI_SOURCE, TAG_WORK, MPI_COMM_WORLD);
             } else {
-                continue; // Not involved in this swap
+                MPI_Send(NULL, 0, MPI_CHAR, st.MPI_SOURCE, TAG_STOP, MPI_COMM_WORLD);
+                stopped++;
             }
+        }
+    } else {
+        // worker: the time between asking and getting an answer is idle
+        for (;;) {
+            t = MPI_Wtime();
+            MPI_Send(&dummy, 1, MPI_INT, 0, TAG_READY, MPI_COMM_WORLD);
+            MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &st);
+            MPI_Get_count(&st, MPI_CHAR, &len);
+            names = (char *)realloc(names, len + 1);
+            if (names == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+            MPI_Recv(names, len, MPI_CHAR, 0, st.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            stats[FARM_IDLE] += (MPI_Wtime() - t) * 1000;
+            if (st.MPI_TAG == TAG_STOP) break;
 
-            localRowIdx = getMyIdx(globalRowIdx);
-            Offset = (size_t)localRowIdx * rowSize;
-            
-            //Swap
-            memcpy(Buff, img + Offset, rowSize);
-            start_time = MPI_Wtime();
-            MPI_Sendrecv(Buff, rowSize, MPI_UNSIGNED_CHAR, partnerRank, 0,
-                         img + Offset, rowSize, MPI_UNSIGNED_CHAR, partnerRank, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            end_time = MPI_Wtime();
-            elapsed_time = (end_time - start_time) * 1000;
-
-            sendrecvOH += elapsed_time;
+            t = MPI_Wtime();
+            for (char *name = strtok(names, "\n"); name != NULL; name = strtok(NULL, "\n"))
+                FarmImage(name, outDir, Flip, stats);
+            stats[FARM_BUSY] += (MPI_Wtime() - t) * 1000;
         }
     }
+    free(names);
+    MPI_Barrier(MPI_COMM_WORLD);
+    elapsed = MPI_Wtime() - start;
 
-    free(Buff);
+    if (rank == 0) {
+        all = (double *)malloc((size_t)numProcs * FARM_STATS * sizeof(double));
+        if (all == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Gather(stats, FARM_STATS, MPI_DOUBLE, all, FARM_STATS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        double images = 0, bytes = 0, failed = 0;
+        printf("\n%-6s %8s %8s %14s %14s\n", "rank", "images", "skipped", "busy ms", "idle ms");
+        for (i = (numProcs > 1); i < numProcs; i++) {
+            double *r = all + FARM_STATS * i;
+            printf("%-6d %8.0f %8.0f %14.4f %14.4f\n", i, r[FARM_IMAGES], r[FARM_FAILED],
+                   r[FARM_BUSY], r[FARM_IDLE]);
+            images += r[FARM_IMAGES];
+            bytes += r[FARM_BYTES];
+            failed += r[FARM_FAILED];
+        }
+        printf("\nTask farm: %.0f images in %f ms   %.2f images/s   %.2f MB/s of pixels\n",
+               images, elapsed * 1000, images / elapsed, bytes / elapsed / (1024.0 * 1024.0));
+        if (failed > 0) printf("%.0f image(s) could not be read and were skipped\n", failed);
+        for (i = 0; i < FarmCount; i++) free(FarmInputs[i]);
+        free(FarmInputs);
+        free(all);
+    }
+}
+
+/*Per-rank timing report*/
+
+enum { PH_BCAST, PH_SCATTER, PH_FLIP, PH_SENDRECV, PH_GATHER, PH_BARRIER, PH_READ, PH_WRITE,
+       NPHASES };
+const char *PhaseNames[NPHASES] = { "bcast", "scatter", "flip", "sendrecv", "gather",
+                                    "barrier", "read", "write" };
+
+// Gathers every rank's phase times (ms) on rank 0, which prints min/avg/max per phase
+// with the imbalance factor max/avg, and one line per rank into csvName if given
+void ReportRankTimes(double *mine, char *csvName) {
+    double *all = NULL, mn, mx, sum;
+    int r, p;
+
+    if (rank == 0) {
+        all = (double *)malloc((size_t)numProcs * NPHASES * sizeof(double));
+        if (all == NULL) {
+            printf("Rank 0: Failed to allocate the timing table\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_Gather(mine, NPHASES, MPI_DOUBLE, all, NPHASES, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank != 0) return;
+
+    printf("\nPer-rank phase times over %d ranks (ms):\n", numProcs);
+    printf("%-10s %12s %12s %12s %10s\n", "phase", "min", "avg", "max", "max/avg");
+    for (p = 0; p < NPHASES; p++) {
+        mn = mx = all[p];
+        sum = 0;
+        for (r = 0; r < numProcs; r++) {
+            double t = all[r * NPHASES + p];
+            if (t < mn) mn = t;
+            if (t > mx) mx = t;
+            sum += t;
+        }
+        if (sum > 0)
+            printf("%-10s %12.4f %12.4f %12.4f %10.2f\n", PhaseNames[p], mn, sum / numProcs, mx,
+                   mx / (sum / numProcs));
+        else
+            printf("%-10s %12.4f %12.4f %12.4f %10s\n", PhaseNames[p], mn, 0.0, mx, "-");
+    }
+
+    if (csvName != NULL) {
+        FILE *f = fopen(csvName, "w");
+        if (f == NULL) {
+            printf("\n\nFILE CREATION ERROR: %s\n\n", csvName);
+        } else {
+            fprintf(f, "rank");
+            for (p = 0; p < NPHASES; p++) fprintf(f, ",%s_ms", PhaseNames[p]);
+            fprintf(f, "\n");
+            for (r = 0; r < numProcs; r++) {
+                fprintf(f, "%d", r);
+                for (p = 0; p < NPHASES; p++) fprintf(f, ",%f", all[r * NPHASES + p]);
+                fprintf(f, "\n");
+            }
+            fclose(f);
+        }
+    }
+    free(all);
+}
+
+void PrintUsage(char *prog) {
+    fprintf(stderr, "Usage: %s [-i | -k chunks | -w] [-t threads] [-c ranks.csv] <input.bmp> <output.bmp> <V|H|C|A|T>\n", prog);
+    fprintf(stderr, "       %s -f batch [-t threads] <input dir | list file> <output dir> <V|H>\n", prog);
+    fprintf(stderr, "  C/A rotate by 90 degrees clockwise/counter-clockwise, T transposes; these\n"
+                    "  redistribute the rows with MPI_Alltoallv and take -i but not -k or -w\n");
+    fprintf(stderr, "  -i  MPI-IO: every rank reads and writes its own rows, V flips write them\n"
+                    "      to the mirrored offsets and exchange nothing\n"
+                    "  -k  also run the flip pipelined in chunks per rank with Iscatterv/Igatherv\n"
+                    "      and compare with the serialized Scatterv, flip, Gatherv\n"
+                    "  -w  one shared-memory window per node, flipped in place by its ranks;\n"
+                    "      only the node leaders scatter and gather\n"
+                    "  -t  OpenMP threads per rank for the local row work (default 1, pure MPI)\n"
+                    "  -c  also write every rank's phase times to a CSV file\n"
+                    "  -f  task farm: rank 0 hands out batch file names per request and every\n"
+                    "      other rank flips whole images on its own\n");
+}
+
+void UsageExit(char *prog) {
+    if (rank == 0) PrintUsage(prog);
+    MPI_Finalize();
+    exit(EXIT_FAILURE);
 }
 
 
 int main(int argc, char** argv) {
     double start_time, end_time, elapsed_time, op_start, op_end, comm_time = 0; //Timing variables
-	//MPI initialization
-    MPI_Init(&argc, &argv);
+    double rotateBytes = 0, totalRotateBytes = 0, maxRotate = 0;
+    double maxRead, maxWrite, bcastTime = 0, barrierTime = 0, scatterTime = 0, gatherTime = 0, pipeTime = 0, pipeWait = 0;
+    char *csvName = NULL;
+    int mpiio = 0, chunks = 0, shared = 0, farmBatch = 0, nodes = 0, opt, first, provided;
+	//MPI initialization, only the main thread of a rank makes MPI calls
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
 	
     //Process commandline arguments
 	char InputFileName[255], OutputFileName[255];
 	char 				Flip;
-    if (argc < 4) {
-        if (rank == 0) fprintf(stderr, "Usage: %s <input.bmp> <output.bmp> <Flip>\n", argv[0]);
+    while ((opt = getopt(argc, argv, "c:f:ik:t:w")) != -1) {
+        switch (opt) {
+            case 'c': csvName = optarg; break;
+            case 'i': mpiio = 1; break;
+            case 'w': shared = 1; break;
+            case 'f':
+                farmBatch = atoi(optarg);
+                if (farmBatch < 1) UsageExit(argv[0]);
+                break;
+            case 'k':
+                chunks = atoi(optarg);
+                if (chunks < 1) UsageExit(argv[0]);
+                break;
+            case 't':
+                numThreads = atoi(optarg);
+                if (numThreads < 1) UsageExit(argv[0]);
+                break;
+            default: UsageExit(argv[0]);
+        }
+    }
+    if (argc - optind < 3 || mpiio + (chunks > 0) + shared + (farmBatch > 0) > 1)
+        UsageExit(argv[0]);
+	strcpy(InputFileName, argv[optind]);
+	strcpy(OutputFileName, argv[optind + 1]);
+	Flip = toupper(argv[optind + 2][0]);
+    int rotate = (Flip == 'C' || Flip == 'A' || Flip == 'T');
+    if ((Flip != 'V' && Flip != 'H' && !rotate) ||
+        (rotate && (chunks || shared || farmBatch)))
+        UsageExit(argv[0]);
+    if (provided < MPI_THREAD_FUNNELED && numThreads > 1) {
+        if (rank == 0) printf("MPI library has no MPI_THREAD_FUNNELED support, using 1 thread per rank\n");
+        numThreads = 1;
+    }
+    omp_set_num_threads(numThreads);
+    if (farmBatch) {
+        InitPixelReverse();
+        RunTaskFarm(InputFileName, OutputFileName, Flip, farmBatch);
         MPI_Finalize();
-        exit(EXIT_FAILURE);
+        return 0;
     }
-	strcpy(InputFileName, argv[1]);
-	strcpy(OutputFileName, argv[2]);
-	Flip = toupper(argv[3][0]);
+    const char* revKernel = InitPixelReverse(); // SIMD kernel for H flips
+    unsigned char* localImage;
+    unsigned char* OutImage = NULL; // -k: both runs gather here, the input stays intact
+    int* sendcounts = NULL;
+    int* displs = NULL; //displacement (offset)
+
+    if (mpiio) {
+        // every rank reads its own rows, only the header is broadcast
+        localImage = ReadRowsMPIIO(InputFileName, &elapsed_time);
+        bcastTime = elapsed_time;
+        comm_time += elapsed_time;
+        if (rank == 0) start_time = MPI_Wtime() - elapsed_time / 1000;
+    } else {
     if (rank == 0) { //Only rank 0 will read the image
+        op_start = MPI_Wtime();
         TheImage = ReadBMPlin(InputFileName);
+        if (TheImage == NULL) MPI_Abort(MPI_COMM_WORLD, 1); // the others wait in the Bcast
         start_time = MPI_Wtime(); //Timestamp, program starts
+        readTime = (start_time - op_start) * 1000;
     }
 
     op_start = MPI_Wtime();
     MPI_Bcast(&ip, sizeof(struct ImgProp), MPI_BYTE, 0, MPI_COMM_WORLD); // Broadcast image properties to all processes
     op_end = MPI_Wtime();
     elapsed_time = (op_end - op_start)*1000;
+    bcastTime = elapsed_time;
     comm_time += elapsed_time;
 
-    // How the rows are distributed
-    rowsPerProc = ip.Vpixels / numProcs;
-    localRows = (rank == numProcs - 1) ? ip.Vpixels - rank * rowsPerProc : rowsPerProc;
-    localSize = localRows * ip.Hbytes; //Size of the image portion each rank handles
+    PartitionRows();
 
+    if (shared) {
+        // no local copies: the ranks of a node flip its window in place
+        SharedWindowFlip(Flip, &scatterTime, &gatherTime, &nodes);
+        comm_time += scatterTime;
+        localImage = NULL;
+    } else {
     // Allocate local buffer
-    unsigned char* localImage = (unsigned char*)malloc(localSize);
+    localImage = (unsigned char*)malloc(localSize);
     if (!localImage) {
         fprintf(stderr, "Memory allocation failed on rank %d\n", rank);
         MPI_Finalize();
@@ -212,18 +1005,10 @@ int main(int argc, char** argv) {
     }
 
     // Scatter image data (Distribute)
-    int* sendcounts = NULL;
-    int* displs = NULL; //displacement (offset)
     if (rank == 0) {
         sendcounts = malloc(numProcs * sizeof(int));
         displs = malloc(numProcs * sizeof(int));
-        int offset = 0;
-        for (int i = 0; i < numProcs; ++i) {
-            int r = (i == numProcs - 1) ? ip.Vpixels - i * rowsPerProc : rowsPerProc;
-            sendcounts[i] = r * ip.Hbytes;
-            displs[i] = offset;
-            offset += sendcounts[i];
-        }
+        RowCounts(sendcounts, displs);
     }
 
     op_start = MPI_Wtime();
@@ -231,42 +1016,140 @@ int main(int argc, char** argv) {
                  localImage, localSize, MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
     op_end = MPI_Wtime();
     elapsed_time = (op_end - op_start)*1000;
+    scatterTime = elapsed_time;
     comm_time += elapsed_time;
+    }
+    }
 
     // Perform flipping on assigned rows
+    if (!shared) {
     op_start = MPI_Wtime();
     switch(Flip){
-		case 'V': FlipImageV(localImage); break;
-		case 'H': FlipImageH(localImage); break;
-		default: exit(EXIT_FAILURE);
+		case 'V':
+            if (mpiio) ReverseLocalRows(localImage, localRows);
+            else FlipImageV(localImage);
+            break;
+		case 'H': FlipImageH(localImage, localRows); break;
+		case 'C': case 'A': case 'T':
+            localImage = RotateDistributed(localImage, Flip, &rotateBytes);
+            break;
 	}
     op_end = MPI_Wtime();
     flipTime = (op_end - op_start) *1000; //How long each rank took to flip
+    }
+
+    int totalMessages = 0;
+    if (mpiio) {
+        // V: my rows land on the mirrored global rows, already in reverse order; a
+        // rotation left the rotated rows partitioned as rankRows() now says
+        rankRows(rank, &first, &localRows);
+        if (Flip == 'V') first = ip.Vpixels - (first + localRows);
+        op_start = MPI_Wtime();
+        MPI_Barrier(MPI_COMM_WORLD); // Wait for all procs (Sync)
+        barrierTime = (MPI_Wtime() - op_start) * 1000;
+        if (rank == 0) end_time = MPI_Wtime(); //Time stamp, flips done
+        WriteRowsMPIIO(localImage, OutputFileName, first);
+    } else {
+    if (chunks && rank == 0) {
+        OutImage = (uch *)malloc(IMAGESIZE);
+        if (OutImage == NULL) {
+            printf("\n\nCannot allocate the output image\n\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    // the rotated image has other dimensions, hence other row padding and partition
+    if (rotate && rank == 0) {
+        uch *rotated = (uch *)realloc(TheImage, IMAGESIZE);
+        if (rotated == NULL) {
+            printf("\n\nCannot allocate the rotated image\n\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        TheImage = rotated;
+        RowCounts(sendcounts, displs);
+    }
 
     // Gather results
+    if (shared) {
+        elapsed_time = gatherTime; // done by the node leaders
+    } else {
     op_start = MPI_Wtime();
     MPI_Gatherv(localImage, localSize, MPI_UNSIGNED_CHAR,
-                TheImage, sendcounts, displs, MPI_UNSIGNED_CHAR,
+                chunks ? OutImage : TheImage, sendcounts, displs, MPI_UNSIGNED_CHAR,
                 0, MPI_COMM_WORLD);
     op_end = MPI_Wtime();
     elapsed_time = (op_end - op_start)*1000;
+    gatherTime = elapsed_time;
+    }
 
     comm_time += elapsed_time;
-    comm_time += sendrecvOH;
+    MPI_Reduce(&vflipMessages, &totalMessages, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    op_start = MPI_Wtime();
     MPI_Barrier(MPI_COMM_WORLD); // Wait for all procs (Sync)
+    barrierTime = (MPI_Wtime() - op_start) * 1000;
+    if (rank == 0) end_time = MPI_Wtime(); //Time stamp, prog ends
+
+    // same flip again from the same input, pipelined; the slowest rank counts
+    if (chunks) {
+        double t = PipelinedFlip(TheImage, OutImage, localImage, Flip, chunks, &elapsed_time);
+        MPI_Reduce(&t, &pipeTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&elapsed_time, &pipeWait, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    }
+    if (rank == 0) {
+        op_start = MPI_Wtime();
+        WriteBMPlin(chunks ? OutImage : TheImage, OutputFileName);
+        writeTime = (MPI_Wtime() - op_start) * 1000;
+    }
+    }
+
+    comm_time += sendrecvOH;
+    if (rotate) {
+        MPI_Reduce(&rotateBytes, &totalRotateBytes, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&sendrecvOH, &maxRotate, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    }
+    // collective I/O runs on every rank, the slowest one counts
+    MPI_Reduce(&readTime, &maxRead, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&writeTime, &maxWrite, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     if (rank == 0) {
-        end_time = MPI_Wtime(); //Time stamp, prog ends
-        WriteBMPlin(TheImage, OutputFileName);
 		elapsed_time = (end_time - start_time)*1000; 
         //Print timing
 		printf("\nProgram Executed %c flip and took %f ms. \n",Flip, elapsed_time);
-        printf("Total Communication overhead: %f ms\n", comm_time);
-        printf("Total \"flipping\" time: %f ms\n",elapsed_time-comm_time);
+        printf("Pixel reversal kernel: %s\n", revKernel);
+        printf("Ranks x threads: %d x %d\n", numProcs, numThreads);
+        printf("Total Communication overhead: %f ms (rank 0)\n", comm_time);
+        if (shared)
+            printf("Shared-memory windows: %d node(s), Scatterv/Gatherv between node leaders only\n", nodes);
+        if (Flip == 'V' && !mpiio && !shared)
+            printf("Vertical flip blocks exchanged: %d\n", totalMessages);
+        if (rotate)
+            printf("Rotation all-to-all: %.0f bytes (%.2f MB) between ranks, %f ms on the slowest rank\n",
+                   totalRotateBytes, totalRotateBytes / (1024.0 * 1024.0), maxRotate);
+        printf("Total \"flipping\" time: %f ms (total minus rank 0's communication)\n",elapsed_time-comm_time);
+        printf("File I/O (not included above): read %f ms, write %f ms (%s)\n", maxRead,
+               maxWrite, mpiio ? "MPI-IO, all ranks" : "rank 0");
+        if (chunks) {
+            // communication the pipeline hid behind the flips, against the serialized run
+            double serialComm = scatterTime + gatherTime + sendrecvOH;
+            double serialTotal = scatterTime + flipTime + gatherTime;
+            printf("\nSerialized: scatter %f ms + flip %f ms + gather %f ms = %f ms\n",
+                   scatterTime, flipTime, gatherTime, serialTotal);
+            printf("Pipelined, %d chunks per rank: %f ms, %f ms blocked on communication\n",
+                   chunks, pipeTime, pipeWait);
+            printf("Overlap: %.1f%% of the serialized communication hidden, %.2fx speedup\n",
+                   serialComm > 0 ? 100.0 * (serialComm - pipeWait) / serialComm : 0.0,
+                   pipeTime > 0 ? serialTotal / pipeTime : 0.0);
+        }
+        free(OutImage);
         free(TheImage); // Free main image
         free(sendcounts);
         free(displs);
     }
     free(localImage); // Each procs frees their local image
+
+    // the flip phase without the block exchange it waited on, which is sendrecv
+    double phases[NPHASES] = { bcastTime, scatterTime, flipTime - sendrecvOH, sendrecvOH,
+                               gatherTime, barrierTime, readTime, writeTime };
+    ReportRankTimes(phases, csvName);
     
     MPI_Finalize(); //Prog ends
     return 0;
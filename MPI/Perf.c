@@ -0,0 +1,172 @@
+#include "Perf.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int Fds[PERF_MAXTHREADS][PERF_NEVENTS];
+static int Opened[PERF_MAXTHREADS]; // PerfOpenThread() ran for the thread
+static int OpenErrno[PERF_MAXTHREADS];
+
+static const char *EventNames[PERF_NEVENTS] = {
+    "cycles", "instructions", "LLC-misses", "dTLB-misses", "branch-misses"};
+
+static void EventAttr(int event, struct perf_event_attr *attr) {
+  memset(attr, 0, sizeof(*attr));
+  attr->size = sizeof(*attr);
+  attr->disabled = 1;
+  attr->exclude_kernel = 1; // allowed up to perf_event_paranoid 2
+  attr->exclude_hv = 1;
+  attr->read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr->type = PERF_TYPE_HARDWARE;
+  switch (event) {
+  case PERF_CYCLES:
+    attr->config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case PERF_INSTRUCTIONS:
+    attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case PERF_LLC_MISSES:
+    attr->config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  case PERF_DTLB_MISSES:
+    attr->type = PERF_TYPE_HW_CACHE;
+    attr->config = PERF_COUNT_HW_CACHE_DTLB |
+                   (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    break;
+  case PERF_BRANCH_MISSES:
+    attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  }
+}
+
+int PerfOpenThread(int tid) {
+  struct perf_event_attr attr;
+  int e, n = 0;
+
+  if (tid < 0 || tid >= PERF_MAXTHREADS) {
+    return 0;
+  }
+  OpenErrno[tid] = 0;
+  for (e = 0; e < PERF_NEVENTS; e++) {
+    EventAttr(e, &attr);
+    // pid 0, cpu -1: this thread, on whichever CPU it runs
+    Fds[tid][e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (Fds[tid][e] >= 0) {
+      n++;
+    } else if (OpenErrno[tid] == 0) {
+      OpenErrno[tid] = errno;
+    }
+  }
+  Opened[tid] = 1;
+  return n;
+}
+
+static void IoctlAll(unsigned long request) {
+  int t, e;
+
+  for (t = 0; t < PERF_MAXTHREADS; t++) {
+    for (e = 0; Opened[t] && e < PERF_NEVENTS; e++) {
+      if (Fds[t][e] >= 0) {
+        ioctl(Fds[t][e], request, 0);
+      }
+    }
+  }
+}
+
+void PerfStart(void) { IoctlAll(PERF_EVENT_IOC_ENABLE); }
+
+void PerfStop(void) { IoctlAll(PERF_EVENT_IOC_DISABLE); }
+
+// Count of one event, scaled up when the kernel had to multiplex it
+static int ReadCount(int fd, double *count) {
+  uint64_t v[3]; // value, time enabled, time running
+
+  if (fd < 0 || read(fd, v, sizeof(v)) != sizeof(v)) {
+    return -1;
+  }
+  *count = (double)v[0];
+  if (v[2] > 0 && v[2] < v[1]) {
+    *count *= (double)v[1] / (double)v[2];
+  }
+  return 0;
+}
+
+void PerfReport(double units, const char *unit) {
+  double total[PERF_NEVENTS] = {0}, c;
+  int have[PERF_NEVENTS] = {0};
+  int t, e, threads = 0, err = 0, any = 0;
+
+  for (t = 0; t < PERF_MAXTHREADS; t++) {
+    for (e = 0; Opened[t] && e < PERF_NEVENTS; e++) {
+      have[e] |= (Fds[t][e] >= 0);
+    }
+    threads += Opened[t];
+    err = (Opened[t] && OpenErrno[t] && !err) ? OpenErrno[t] : err;
+  }
+  for (e = 0; e < PERF_NEVENTS; e++) {
+    any |= have[e];
+  }
+  if (!any) {
+    printf("\nPerformance counters unavailable (perf_event_open: %s), check "
+           "/proc/sys/kernel/perf_event_paranoid\n",
+           strerror(err ? err : ENOSYS));
+    return;
+  }
+
+  printf("\nPerformance counters, user space, %d threads:\n  thread", threads);
+  for (e = 0; e < PERF_NEVENTS; e++) {
+    printf("  %14s", EventNames[e]);
+  }
+  for (t = 0; t < PERF_MAXTHREADS; t++) {
+    if (!Opened[t]) {
+      continue;
+    }
+    printf("\n  %6d", t);
+    for (e = 0; e < PERF_NEVENTS; e++) {
+      if (ReadCount(Fds[t][e], &c) == 0) {
+        total[e] += c;
+        printf("  %14.0f", c);
+      } else {
+        printf("  %14s", "n/a");
+      }
+    }
+  }
+  printf("\n   total");
+  for (e = 0; e < PERF_NEVENTS; e++) {
+    if (have[e]) {
+      printf("  %14.0f", total[e]);
+    } else {
+      printf("  %14s", "n/a");
+    }
+  }
+
+  if (have[PERF_CYCLES] && have[PERF_INSTRUCTIONS] && total[PERF_CYCLES] > 0) {
+    printf("\nIPC = %.3f", total[PERF_INSTRUCTIONS] / total[PERF_CYCLES]);
+  }
+  for (e = PERF_LLC_MISSES; e < PERF_NEVENTS; e++) {
+    if (have[e] && units > 0) {
+      printf("   %s/%s = %.5f", EventNames[e], unit, total[e] / units);
+    }
+  }
+  printf("\n");
+}
+
+void PerfClose(void) {
+  int t, e;
+
+  for (t = 0; t < PERF_MAXTHREADS; t++) {
+    for (e = 0; Opened[t] && e < PERF_NEVENTS; e++) {
+      if (Fds[t][e] >= 0) {
+        close(Fds[t][e]);
+      }
+    }
+    Opened[t] = 0;
+  }
+}
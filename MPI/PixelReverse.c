@@ -0,0 +1,491 @@
+/******************************************************************************
+ * DESCRIPTION:
+ *   Vectorized 24-bit pixel reversal kernels used by the horizontal flips.
+ *   A row is reversed from both ends at once: a block of 16 BGR pixels is
+ *   loaded from the left and from the right end, each block has its pixel
+ *   order reversed in registers with byte shuffles and the two blocks are
+ *   stored swapped. Whatever is left in the middle is finished by the scalar
+ *   kernel. The SSSE3 kernel works on 48-byte blocks, AVX2 on 96 and AVX-512
+ *   on 192, so the AVX2/AVX-512 kernels run several 48-byte reversals side by
+ *   side, one per 128-bit lane, and fix the lane order up with permutes.
+ *   The copying variants use the same block reversal, reading the source
+ *   front to back and filling the destination back to front.
+ *   8-bit (grayscale, palette) and 32-bit (BGRA) rows get the same kernels,
+ *   but there a register of pixels is reversed with a single shuffle or
+ *   permute, so they cost less per byte than the 24-bit ones.
+ ******************************************************************************/
+#include "PixelReverse.h"
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+void (*ReverseRow24)(unsigned char *row, int npixels) = ReverseRow24Scalar;
+void (*ReverseCopyRow24)(unsigned char *dst, const unsigned char *src,
+                         int npixels) = ReverseCopyRow24Scalar;
+
+void (*ReverseRow8)(unsigned char *row, int npixels) = ReverseRow8Scalar;
+void (*ReverseCopyRow8)(unsigned char *dst, const unsigned char *src,
+                        int npixels) = ReverseCopyRow8Scalar;
+void (*ReverseRow32)(unsigned char *row, int npixels) = ReverseRow32Scalar;
+void (*ReverseCopyRow32)(unsigned char *dst, const unsigned char *src,
+                         int npixels) = ReverseCopyRow32Scalar;
+
+// a whole 32-bit pixel, wherever the row buffer starts
+typedef uint32_t Pixel32 __attribute__((aligned(1), may_alias));
+
+void ReverseRow24Scalar(unsigned char *row, int npixels) {
+  unsigned char *lo = row;
+  unsigned char *hi = row + (long)npixels * 3 - 3;
+  unsigned char B, G, R;
+
+  while (lo < hi) {
+    B = lo[0];
+    G = lo[1];
+    R = lo[2];
+    lo[0] = hi[0];
+    lo[1] = hi[1];
+    lo[2] = hi[2];
+    hi[0] = B;
+    hi[1] = G;
+    hi[2] = R;
+    lo += 3;
+    hi -= 3;
+  }
+}
+
+void ReverseCopyRow24Scalar(unsigned char *dst, const unsigned char *src,
+                            int npixels) {
+  unsigned char *d = dst + (long)npixels * 3 - 3;
+
+  while (d >= dst) {
+    d[0] = src[0];
+    d[1] = src[1];
+    d[2] = src[2];
+    src += 3;
+    d -= 3;
+  }
+}
+
+void ReverseRow8Scalar(unsigned char *row, int npixels) {
+  unsigned char *lo = row;
+  unsigned char *hi = row + npixels - 1;
+  unsigned char t;
+
+  while (lo < hi) {
+    t = *lo;
+    *lo++ = *hi;
+    *hi-- = t;
+  }
+}
+
+void ReverseCopyRow8Scalar(unsigned char *dst, const unsigned char *src,
+                           int npixels) {
+  unsigned char *d = dst + npixels - 1;
+
+  while (d >= dst) {
+    *d-- = *src++;
+  }
+}
+
+void ReverseRow32Scalar(unsigned char *row, int npixels) {
+  Pixel32 *lo = (Pixel32 *)row;
+  Pixel32 *hi = lo + npixels - 1;
+  uint32_t t;
+
+  while (lo < hi) {
+    t = *lo;
+    *lo++ = *hi;
+    *hi-- = t;
+  }
+}
+
+void ReverseCopyRow32Scalar(unsigned char *dst, const unsigned char *src,
+                            int npixels) {
+  Pixel32 *d = (Pixel32 *)dst + npixels - 1;
+  const Pixel32 *s = (const Pixel32 *)src;
+
+  while (d >= (Pixel32 *)dst) {
+    *d-- = *s++;
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+// RevMask[k][i] moves the bytes of input lane i that belong in output lane k
+// when a 48-byte block (16 pixels, 3 lanes) has its pixel order reversed.
+// Bytes that come from another lane are 0x80, which pshufb turns into zero.
+static unsigned char RevMask[3][3][16] __attribute__((aligned(16)));
+
+static void BuildRevMasks(void) {
+  int k, i, t, j, src;
+
+  for (k = 0; k < 3; k++) {
+    for (i = 0; i < 3; i++) {
+      for (t = 0; t < 16; t++) {
+        j = 16 * k + t;                  // output byte
+        src = 3 * (15 - j / 3) + j % 3;  // input byte it comes from
+        RevMask[k][i][t] = (src / 16 == i) ? (unsigned char)(src % 16) : 0x80;
+      }
+    }
+  }
+}
+
+#define MASK128(k, i) _mm_load_si128((const __m128i *)RevMask[k][i])
+
+/*---------------------------------- SSSE3 ----------------------------------*/
+
+__attribute__((target("ssse3"))) static inline void
+Rev48x128(__m128i *a, __m128i *b, __m128i *c) {
+  __m128i x = _mm_or_si128(_mm_shuffle_epi8(*b, MASK128(0, 1)),
+                           _mm_shuffle_epi8(*c, MASK128(0, 2)));
+  __m128i y = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(*a, MASK128(1, 0)),
+                                        _mm_shuffle_epi8(*b, MASK128(1, 1))),
+                           _mm_shuffle_epi8(*c, MASK128(1, 2)));
+  __m128i z = _mm_or_si128(_mm_shuffle_epi8(*a, MASK128(2, 0)),
+                           _mm_shuffle_epi8(*b, MASK128(2, 1)));
+  *a = x;
+  *b = y;
+  *c = z;
+}
+
+__attribute__((target("ssse3"))) static void
+ReverseRow24SSSE3(unsigned char *row, int npixels) {
+  unsigned char *lo = row;
+  unsigned char *hi = row + (long)npixels * 3;
+  __m128i l0, l1, l2, h0, h1, h2;
+
+  while (hi - lo >= 2 * 48) {
+    hi -= 48;
+    l0 = _mm_loadu_si128((const __m128i *)(lo));
+    l1 = _mm_loadu_si128((const __m128i *)(lo + 16));
+    l2 = _mm_loadu_si128((const __m128i *)(lo + 32));
+    h0 = _mm_loadu_si128((const __m128i *)(hi));
+    h1 = _mm_loadu_si128((const __m128i *)(hi + 16));
+    h2 = _mm_loadu_si128((const __m128i *)(hi + 32));
+    Rev48x128(&l0, &l1, &l2);
+    Rev48x128(&h0, &h1, &h2);
+    _mm_storeu_si128((__m128i *)(lo), h0);
+    _mm_storeu_si128((__m128i *)(lo + 16), h1);
+    _mm_storeu_si128((__m128i *)(lo + 32), h2);
+    _mm_storeu_si128((__m128i *)(hi), l0);
+    _mm_storeu_si128((__m128i *)(hi + 16), l1);
+    _mm_storeu_si128((__m128i *)(hi + 32), l2);
+    lo += 48;
+  }
+  ReverseRow24Scalar(lo, (int)((hi - lo) / 3));
+}
+
+__attribute__((target("ssse3"))) static void
+ReverseCopyRow24SSSE3(unsigned char *dst, const unsigned char *src,
+                      int npixels) {
+  unsigned char *d = dst + (long)npixels * 3;
+  __m128i s0, s1, s2;
+
+  while (d - dst >= 48) {
+    d -= 48;
+    s0 = _mm_loadu_si128((const __m128i *)(src));
+    s1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    s2 = _mm_loadu_si128((const __m128i *)(src + 32));
+    Rev48x128(&s0, &s1, &s2);
+    _mm_storeu_si128((__m128i *)(d), s0);
+    _mm_storeu_si128((__m128i *)(d + 16), s1);
+    _mm_storeu_si128((__m128i *)(d + 32), s2);
+    src += 48;
+  }
+  // the last few source pixels land at the start of dst
+  ReverseCopyRow24Scalar(dst, src, (int)((d - dst) / 3));
+}
+
+/*----------------------------------- AVX2 ----------------------------------*/
+
+#define MASK256(k, i) _mm256_broadcastsi128_si256(MASK128(k, i))
+
+// Reverses 96 bytes (32 pixels) held in three ymm registers.
+__attribute__((target("avx2"))) static inline void
+Rev96x256(__m256i *y0, __m256i *y1, __m256i *y2) {
+  // regroup the six lanes L0..L5 so that every register holds the same lane
+  // of both 48-byte halves, second half first: A=(L3,L0) B=(L4,L1) C=(L5,L2)
+  __m256i a = _mm256_permute2x128_si256(*y1, *y0, 0x21);
+  __m256i b = _mm256_permute2x128_si256(*y2, *y0, 0x30);
+  __m256i c = _mm256_permute2x128_si256(*y2, *y1, 0x21);
+
+  __m256i x = _mm256_or_si256(_mm256_shuffle_epi8(b, MASK256(0, 1)),
+                              _mm256_shuffle_epi8(c, MASK256(0, 2)));
+  __m256i y = _mm256_or_si256(
+      _mm256_or_si256(_mm256_shuffle_epi8(a, MASK256(1, 0)),
+                      _mm256_shuffle_epi8(b, MASK256(1, 1))),
+      _mm256_shuffle_epi8(c, MASK256(1, 2)));
+  __m256i z = _mm256_or_si256(_mm256_shuffle_epi8(a, MASK256(2, 0)),
+                              _mm256_shuffle_epi8(b, MASK256(2, 1)));
+
+  // x=(O0,O3) y=(O1,O4) z=(O2,O5) -> (O0,O1) (O2,O3) (O4,O5)
+  *y0 = _mm256_permute2x128_si256(x, y, 0x20);
+  *y1 = _mm256_permute2x128_si256(z, x, 0x30);
+  *y2 = _mm256_permute2x128_si256(y, z, 0x31);
+}
+
+__attribute__((target("avx2"))) static void
+ReverseRow24AVX2(unsigned char *row, int npixels) {
+  unsigned char *lo = row;
+  unsigned char *hi = row + (long)npixels * 3;
+  __m256i l0, l1, l2, h0, h1, h2;
+
+  while (hi - lo >= 2 * 96) {
+    hi -= 96;
+    l0 = _mm256_loadu_si256((const __m256i *)(lo));
+    l1 = _mm256_loadu_si256((const __m256i *)(lo + 32));
+    l2 = _mm256_loadu_si256((const __m256i *)(lo + 64));
+    h0 = _mm256_loadu_si256((const __m256i *)(hi));
+    h1 = _mm256_loadu_si256((const __m256i *)(hi + 32));
+    h2 = _mm256_loadu_si256((const __m256i *)(hi + 64));
+    Rev96x256(&l0, &l1, &l2);
+    Rev96x256(&h0, &h1, &h2);
+    _mm256_storeu_si256((__m256i *)(lo), h0);
+    _mm256_storeu_si256((__m256i *)(lo + 32), h1);
+    _mm256_storeu_si256((__m256i *)(lo + 64), h2);
+    _mm256_storeu_si256((__m256i *)(hi), l0);
+    _mm256_storeu_si256((__m256i *)(hi + 32), l1);
+    _mm256_storeu_si256((__m256i *)(hi + 64), l2);
+    lo += 96;
+  }
+  // at most one 48-byte block per side is left, SSSE3 finishes it
+  ReverseRow24SSSE3(lo, (int)((hi - lo) / 3));
+}
+
+__attribute__((target("avx2"))) static void
+ReverseCopyRow24AVX2(unsigned char *dst, const unsigned char *src,
+                     int npixels) {
+  unsigned char *d = dst + (long)npixels * 3;
+  __m256i s0, s1, s2;
+
+  while (d - dst >= 96) {
+    d -= 96;
+    s0 = _mm256_loadu_si256((const __m256i *)(src));
+    s1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+    s2 = _mm256_loadu_si256((const __m256i *)(src + 64));
+    Rev96x256(&s0, &s1, &s2);
+    _mm256_storeu_si256((__m256i *)(d), s0);
+    _mm256_storeu_si256((__m256i *)(d + 32), s1);
+    _mm256_storeu_si256((__m256i *)(d + 64), s2);
+    src += 96;
+  }
+  ReverseCopyRow24SSSE3(dst, src, (int)((d - dst) / 3));
+}
+
+/*--------------------------------- AVX-512 ---------------------------------*/
+
+#define MASK512(k, i) _mm512_broadcast_i32x4(MASK128(k, i))
+
+// Reverses 192 bytes (64 pixels) held in three zmm registers.
+__attribute__((target("avx512f,avx512bw"))) static inline void
+Rev192x512(__m512i *z0, __m512i *z1, __m512i *z2) {
+  __m512i t;
+
+  // regroup lanes L0..L11: A=(L9,L6,L3,L0) B=(L10,L7,L4,L1) C=(L11,L8,L5,L2)
+  t = _mm512_permutex2var_epi64(*z0, _mm512_setr_epi64(0, 1, 12, 13, 6, 7, 0, 1),
+                                *z1);
+  __m512i a = _mm512_mask_permutexvar_epi64(
+      t, 0x03, _mm512_setr_epi64(2, 3, 0, 0, 0, 0, 0, 0), *z2);
+  t = _mm512_permutex2var_epi64(*z0, _mm512_setr_epi64(0, 1, 14, 15, 8, 9, 2, 3),
+                                *z1);
+  __m512i b = _mm512_mask_permutexvar_epi64(
+      t, 0x03, _mm512_setr_epi64(4, 5, 0, 0, 0, 0, 0, 0), *z2);
+  t = _mm512_permutex2var_epi64(*z0, _mm512_setr_epi64(0, 1, 0, 1, 10, 11, 4, 5),
+                                *z1);
+  __m512i c = _mm512_mask_permutexvar_epi64(
+      t, 0x0F, _mm512_setr_epi64(6, 7, 0, 1, 0, 0, 0, 0), *z2);
+
+  __m512i x = _mm512_or_si512(_mm512_shuffle_epi8(b, MASK512(0, 1)),
+                              _mm512_shuffle_epi8(c, MASK512(0, 2)));
+  __m512i y = _mm512_or_si512(
+      _mm512_or_si512(_mm512_shuffle_epi8(a, MASK512(1, 0)),
+                      _mm512_shuffle_epi8(b, MASK512(1, 1))),
+      _mm512_shuffle_epi8(c, MASK512(1, 2)));
+  __m512i z = _mm512_or_si512(_mm512_shuffle_epi8(a, MASK512(2, 0)),
+                              _mm512_shuffle_epi8(b, MASK512(2, 1)));
+
+  // x=(O0,O3,O6,O9) y=(O1,O4,O7,O10) z=(O2,O5,O8,O11) -> O0..O11 in order
+  t = _mm512_permutex2var_epi64(x, _mm512_setr_epi64(0, 1, 8, 9, 0, 0, 2, 3), y);
+  *z0 = _mm512_mask_permutexvar_epi64(
+      t, 0x30, _mm512_setr_epi64(0, 0, 0, 0, 0, 1, 0, 0), z);
+  t = _mm512_permutex2var_epi64(x, _mm512_setr_epi64(10, 11, 0, 0, 4, 5, 12, 13),
+                                y);
+  *z1 = _mm512_mask_permutexvar_epi64(
+      t, 0x0C, _mm512_setr_epi64(0, 0, 2, 3, 0, 0, 0, 0), z);
+  t = _mm512_permutex2var_epi64(x, _mm512_setr_epi64(0, 0, 6, 7, 14, 15, 0, 0),
+                                y);
+  *z2 = _mm512_mask_permutexvar_epi64(
+      t, 0xC3, _mm512_setr_epi64(4, 5, 0, 0, 0, 0, 6, 7), z);
+}
+
+__attribute__((target("avx512f,avx512bw,avx2"))) static void
+ReverseRow24AVX512(unsigned char *row, int npixels) {
+  unsigned char *lo = row;
+  unsigned char *hi = row + (long)npixels * 3;
+  __m512i l0, l1, l2, h0, h1, h2;
+
+  while (hi - lo >= 2 * 192) {
+    hi -= 192;
+    l0 = _mm512_loadu_si512((const void *)(lo));
+    l1 = _mm512_loadu_si512((const void *)(lo + 64));
+    l2 = _mm512_loadu_si512((const void *)(lo + 128));
+    h0 = _mm512_loadu_si512((const void *)(hi));
+    h1 = _mm512_loadu_si512((const void *)(hi + 64));
+    h2 = _mm512_loadu_si512((const void *)(hi + 128));
+    Rev192x512(&l0, &l1, &l2);
+    Rev192x512(&h0, &h1, &h2);
+    _mm512_storeu_si512((void *)(lo), h0);
+    _mm512_storeu_si512((void *)(lo + 64), h1);
+    _mm512_storeu_si512((void *)(lo + 128), h2);
+    _mm512_storeu_si512((void *)(hi), l0);
+    _mm512_storeu_si512((void *)(hi + 64), l1);
+    _mm512_storeu_si512((void *)(hi + 128), l2);
+    lo += 192;
+  }
+  ReverseRow24AVX2(lo, (int)((hi - lo) / 3));
+}
+
+__attribute__((target("avx512f,avx512bw,avx2"))) static void
+ReverseCopyRow24AVX512(unsigned char *dst, const unsigned char *src,
+                       int npixels) {
+  unsigned char *d = dst + (long)npixels * 3;
+  __m512i s0, s1, s2;
+
+  while (d - dst >= 192) {
+    d -= 192;
+    s0 = _mm512_loadu_si512((const void *)(src));
+    s1 = _mm512_loadu_si512((const void *)(src + 64));
+    s2 = _mm512_loadu_si512((const void *)(src + 128));
+    Rev192x512(&s0, &s1, &s2);
+    _mm512_storeu_si512((void *)(d), s0);
+    _mm512_storeu_si512((void *)(d + 64), s1);
+    _mm512_storeu_si512((void *)(d + 128), s2);
+    src += 192;
+  }
+  ReverseCopyRow24AVX2(dst, src, (int)((d - dst) / 3));
+}
+
+/*------------------------------ 8 and 32-bit -------------------------------*/
+
+#define LOAD128(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE128(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+#define LOAD512(p) _mm512_loadu_si512((const void *)(p))
+#define STORE512(p, v) _mm512_storeu_si512((void *)(p), (v))
+
+#define REV_BYTES                                                              \
+  15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+
+__attribute__((target("ssse3"))) static inline __m128i Rev8x128(__m128i v) {
+  return _mm_shuffle_epi8(v, _mm_setr_epi8(REV_BYTES));
+}
+
+__attribute__((target("ssse3"))) static inline __m128i Rev32x128(__m128i v) {
+  return _mm_shuffle_epi32(v, 0x1B);
+}
+
+// bytes reversed within each lane, then the lanes swapped
+__attribute__((target("avx2"))) static inline __m256i Rev8x256(__m256i v) {
+  v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(REV_BYTES, REV_BYTES));
+  return _mm256_permute4x64_epi64(v, 0x4E);
+}
+
+__attribute__((target("avx2"))) static inline __m256i Rev32x256(__m256i v) {
+  return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1,
+                                                          0));
+}
+
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+Rev8x512(__m512i v) {
+  v = _mm512_shuffle_epi8(v, _mm512_broadcast_i32x4(_mm_setr_epi8(REV_BYTES)));
+  return _mm512_shuffle_i64x2(v, v, 0x1B);
+}
+
+__attribute__((target("avx512f"))) static inline __m512i Rev32x512(__m512i v) {
+  return _mm512_permutexvar_epi32(
+      _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+      v);
+}
+
+/*
+ * Stamps out the in-place and the copying kernel of one pixel size (BITS)
+ * and instruction set from its register reversal REV. As for 24 bits, what
+ * is left in the middle goes to the NARROWER kernel.
+ */
+#define DEFINE_REVERSE(BITS, ISA, TARGET, VEC, LOAD, STORE, REV, NARROWER)    \
+  __attribute__((target(TARGET))) static void ReverseRow##BITS##ISA(          \
+      unsigned char *row, int npixels) {                                      \
+    unsigned char *lo = row;                                                  \
+    unsigned char *hi = row + (long)npixels * (BITS / 8);                     \
+    VEC l, h;                                                                 \
+                                                                              \
+    while (hi - lo >= 2 * (long)sizeof(VEC)) {                                \
+      hi -= sizeof(VEC);                                                      \
+      l = REV(LOAD(lo));                                                      \
+      h = REV(LOAD(hi));                                                      \
+      STORE(lo, h);                                                           \
+      STORE(hi, l);                                                           \
+      lo += sizeof(VEC);                                                      \
+    }                                                                         \
+    ReverseRow##BITS##NARROWER(lo, (int)((hi - lo) / (BITS / 8)));            \
+  }                                                                           \
+                                                                              \
+  __attribute__((target(TARGET))) static void ReverseCopyRow##BITS##ISA(      \
+      unsigned char *dst, const unsigned char *src, int npixels) {            \
+    unsigned char *d = dst + (long)npixels * (BITS / 8);                      \
+                                                                              \
+    while (d - dst >= (long)sizeof(VEC)) {                                    \
+      d -= sizeof(VEC);                                                       \
+      STORE(d, REV(LOAD(src)));                                               \
+      src += sizeof(VEC);                                                     \
+    }                                                                         \
+    ReverseCopyRow##BITS##NARROWER(dst, src, (int)((d - dst) / (BITS / 8)));  \
+  }
+
+DEFINE_REVERSE(8, SSSE3, "ssse3", __m128i, LOAD128, STORE128, Rev8x128, Scalar)
+DEFINE_REVERSE(8, AVX2, "avx2", __m256i, LOAD256, STORE256, Rev8x256, SSSE3)
+DEFINE_REVERSE(8, AVX512, "avx512f,avx512bw,avx2", __m512i, LOAD512, STORE512,
+               Rev8x512, AVX2)
+DEFINE_REVERSE(32, SSSE3, "ssse3", __m128i, LOAD128, STORE128, Rev32x128,
+               Scalar)
+DEFINE_REVERSE(32, AVX2, "avx2", __m256i, LOAD256, STORE256, Rev32x256, SSSE3)
+DEFINE_REVERSE(32, AVX512, "avx512f,avx512bw,avx2", __m512i, LOAD512,
+               STORE512, Rev32x512, AVX2)
+
+#endif // HAVE_X86_SIMD
+
+// Points the kernels of every pixel size at those of one instruction set
+#define SELECT_REVERSE(ISA)                                                    \
+  do {                                                                         \
+    ReverseRow8 = ReverseRow8##ISA;                                            \
+    ReverseCopyRow8 = ReverseCopyRow8##ISA;                                    \
+    ReverseRow24 = ReverseRow24##ISA;                                          \
+    ReverseCopyRow24 = ReverseCopyRow24##ISA;                                  \
+    ReverseRow32 = ReverseRow32##ISA;                                          \
+    ReverseCopyRow32 = ReverseCopyRow32##ISA;                                  \
+  } while (0)
+
+const char *InitPixelReverse(void) {
+#ifdef HAVE_X86_SIMD
+  BuildRevMasks();
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+    SELECT_REVERSE(AVX512);
+    return "AVX-512";
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    SELECT_REVERSE(AVX2);
+    return "AVX2";
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    SELECT_REVERSE(SSSE3);
+    return "SSSE3";
+  }
+#endif
+  SELECT_REVERSE(Scalar);
+  return "scalar";
+}
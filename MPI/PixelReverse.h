@@ -0,0 +1,81 @@
+#ifndef PIXELREVERSE_H
+#define PIXELREVERSE_H
+
+/**
+ * ReverseRow24 - Reverses the order of the first 'npixels' 24-bit pixels of
+ * 'row' in place. Row padding past npixels * 3 bytes is left untouched.
+ * Points to the fastest kernel for this CPU once InitPixelReverse() has run.
+ */
+extern void (*ReverseRow24)(unsigned char *row, int npixels);
+
+/**
+ * ReverseCopyRow24 - Writes the first 'npixels' 24-bit pixels of 'src' into
+ * 'dst' in reverse order. The rows must not overlap. Dispatched like
+ * ReverseRow24.
+ */
+extern void (*ReverseCopyRow24)(unsigned char *dst, const unsigned char *src,
+                                int npixels);
+
+/**
+ * ReverseRow8, ReverseRow32 - ReverseRow24 for 8-bit (grayscale or palette)
+ * and 32-bit (BGRA) pixels, with their copying variants. Dispatched like
+ * ReverseRow24.
+ */
+extern void (*ReverseRow8)(unsigned char *row, int npixels);
+extern void (*ReverseCopyRow8)(unsigned char *dst, const unsigned char *src,
+                               int npixels);
+extern void (*ReverseRow32)(unsigned char *row, int npixels);
+extern void (*ReverseCopyRow32)(unsigned char *dst, const unsigned char *src,
+                                int npixels);
+
+// the kernels above for 'bpp' bytes per pixel: 1, 3 or 4
+static inline void ReverseRowBpp(unsigned char *row, int npixels, int bpp) {
+  switch (bpp) {
+  case 1:
+    ReverseRow8(row, npixels);
+    break;
+  case 4:
+    ReverseRow32(row, npixels);
+    break;
+  default:
+    ReverseRow24(row, npixels);
+    break;
+  }
+}
+
+static inline void ReverseCopyRowBpp(unsigned char *dst,
+                                     const unsigned char *src, int npixels,
+                                     int bpp) {
+  switch (bpp) {
+  case 1:
+    ReverseCopyRow8(dst, src, npixels);
+    break;
+  case 4:
+    ReverseCopyRow32(dst, src, npixels);
+    break;
+  default:
+    ReverseCopyRow24(dst, src, npixels);
+    break;
+  }
+}
+
+/**
+ * InitPixelReverse - Picks the best reversal kernels of every pixel size
+ * (AVX-512, AVX2, SSSE3 or scalar) from CPUID. Call once at startup, before
+ * any flip.
+ *
+ * @return: the name of the selected kernel, for reporting.
+ */
+const char *InitPixelReverse(void);
+
+void ReverseRow24Scalar(unsigned char *row, int npixels);
+void ReverseCopyRow24Scalar(unsigned char *dst, const unsigned char *src,
+                            int npixels);
+void ReverseRow8Scalar(unsigned char *row, int npixels);
+void ReverseCopyRow8Scalar(unsigned char *dst, const unsigned char *src,
+                           int npixels);
+void ReverseRow32Scalar(unsigned char *row, int npixels);
+void ReverseCopyRow32Scalar(unsigned char *dst, const unsigned char *src,
+                            int npixels);
+
+#endif
@@ -0,0 +1,164 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ImageStuff.h"
+#include "PixelReverse.h"
+#include "StreamFlip.h"
+
+#define SWAP_CHUNK	4096		// bytes of a row swapped at a time
+
+// shared by the streaming threads
+static int 		FdIn, FdOut;
+static char		StreamOp;
+static long		StripRows, NumStrips, NextStrip;
+static pthread_mutex_t	StripLock = PTHREAD_MUTEX_INITIALIZER;
+
+// pread()/pwrite() the whole range, resuming after short transfers
+static void ReadFull(int fd, unsigned char* buf, size_t len, off_t off)
+{
+	ssize_t got;
+	while(len > 0)
+	{
+		got = pread(fd, buf, len, off);
+		if(got <= 0){ printf("\n\nFILE READ ERROR at offset %lld\n\n", (long long)off); exit(1); }
+		buf += got;	off += got;	len -= got;
+	}
+}
+
+static void WriteFull(int fd, unsigned char* buf, size_t len, off_t off)
+{
+	ssize_t put;
+	while(len > 0)
+	{
+		put = pwrite(fd, buf, len, off);
+		if(put <= 0){ printf("\n\nFILE WRITE ERROR at offset %lld\n\n", (long long)off); exit(1); }
+		buf += put;	off += put;	len -= put;
+	}
+}
+
+// Reverses the order of the 'rows' rows held in 'strip'
+static void ReverseStripRows(unsigned char* strip, long rows)
+{
+	unsigned char Buffer[SWAP_CHUNK];
+	unsigned char *top, *bottom;
+	unsigned long off, len;
+	long row;
+
+	for(row = 0; row < rows / 2; row++)
+	{
+		top = strip + row * ip.Hbytes;
+		bottom = strip + (rows - row - 1) * ip.Hbytes;
+		for(off = 0; off < ip.Hbytes; off += len)
+		{
+			len = (ip.Hbytes - off < SWAP_CHUNK) ? ip.Hbytes - off : SWAP_CHUNK;
+			memcpy(Buffer, top + off, len);
+			memcpy(top + off, bottom + off, len);
+			memcpy(bottom + off, Buffer, len);
+		}
+	}
+}
+
+// Each thread claims strips until none are left: read, flip, write back
+static void* StreamWorker(void* arg)
+{
+	unsigned char* strip = (unsigned char*)arg;
+	long s, first, rows, dstRow, r;
+	off_t srcOff;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&StripLock);
+		s = NextStrip++;
+		pthread_mutex_unlock(&StripLock);
+		if(s >= NumStrips) break;
+
+		first = s * StripRows;
+		rows = (first + StripRows <= ip.Vpixels) ? StripRows : ip.Vpixels - first;
+		srcOff = 54 + (off_t)first * ip.Hbytes;
+		ReadFull(FdIn, strip, rows * ip.Hbytes, srcOff);
+		posix_fadvise(FdIn, srcOff, rows * ip.Hbytes, POSIX_FADV_DONTNEED); // not read again
+
+		if(StreamOp == 'V')
+		{
+			// rows [first, first+rows) land reversed on the mirrored rows
+			ReverseStripRows(strip, rows);
+			dstRow = ip.Vpixels - (first + rows);
+		}
+		else
+		{
+			for(r = 0; r < rows; r++) ReverseRow24(strip + r * ip.Hbytes, ip.Hpixels);
+			dstRow = first;
+		}
+		WriteFull(FdOut, strip, rows * ip.Hbytes, 54 + (off_t)dstRow * ip.Hbytes);
+	}
+	return NULL;
+}
+
+int StreamFlip(char* in, char* out, char flip, int nthreads, size_t budget)
+{
+	pthread_t* th;
+	unsigned char** strips;
+	int i;
+
+	FdIn = open(in, O_RDONLY);
+	if(FdIn < 0){ printf("\n\n%s NOT FOUND\n\n", in); exit(EXIT_FAILURE); }
+	ReadFull(FdIn, ip.HeaderInfo, 54, 0);
+	if(CheckBMPHeader(ip.HeaderInfo, 54, in) != 0) exit(EXIT_FAILURE);
+	ip.Hpixels = *(int*)&ip.HeaderInfo[18];
+	ip.Vpixels = *(int*)&ip.HeaderInfo[22];
+	ip.Hbytes = (ip.Hpixels * 3 + 3) & (~3);
+	printf("\n Input File name: %17s  (%u x %u)   File Size=%lu", in,
+			ip.Hpixels, ip.Vpixels, ip.Hbytes * ip.Vpixels);
+
+	// split the budget between the threads, fewer threads if it is tight
+	long maxRows = budget / ip.Hbytes;
+	if(maxRows < 1){ close(FdIn); return -1; }
+	if(nthreads > maxRows) nthreads = maxRows;
+	StripRows = maxRows / nthreads;
+	if(StripRows > ip.Vpixels) StripRows = ip.Vpixels > 0 ? ip.Vpixels : 1;
+	NumStrips = (ip.Vpixels + StripRows - 1) / StripRows;
+	if(nthreads > NumStrips) nthreads = NumStrips > 0 ? NumStrips : 1;
+	NextStrip = 0;
+	StreamOp = flip;
+
+	FdOut = open(out, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(FdOut < 0 || ftruncate(FdOut, 54 + (off_t)ip.Vpixels * ip.Hbytes) != 0)
+	{
+		printf("\n\nFILE CREATION ERROR: %s\n\n", out);
+		exit(EXIT_FAILURE);
+	}
+	WriteFull(FdOut, ip.HeaderInfo, 54, 0);
+
+	printf("\nStreaming with %d threads, %ld-row strips (%.2f MB in flight)\n",
+			nthreads, StripRows, (double)nthreads * StripRows * ip.Hbytes / (1024.0 * 1024.0));
+
+	th = (pthread_t*)malloc(nthreads * sizeof(pthread_t));
+	strips = (unsigned char**)malloc(nthreads * sizeof(unsigned char*));
+	if(!th || !strips){ printf("\n\nCannot allocate the strip buffers\n\n"); exit(EXIT_FAILURE); }
+	for(i = 0; i < nthreads; i++)
+	{
+		strips[i] = (unsigned char*)malloc(StripRows * ip.Hbytes);
+		if(!strips[i]){ printf("\n\nCannot allocate the strip buffers\n\n"); exit(EXIT_FAILURE); }
+		if(pthread_create(&th[i], NULL, StreamWorker, strips[i]) != 0)
+		{
+			printf("\nThread Creation Error. Exiting abruptly... \n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for(i = 0; i < nthreads; i++)
+	{
+		pthread_join(th[i], NULL);
+		free(strips[i]);
+	}
+	free(strips);
+	free(th);
+
+	close(FdIn);
+	if(close(FdOut) != 0){ printf("\n\nFILE WRITE ERROR: %s\n\n", out); exit(EXIT_FAILURE); }
+	printf("\nOutput File name: %17s  (%u x %u)   File Size=%lu\n\n", out, ip.Hpixels, ip.Vpixels, ip.Hbytes * ip.Vpixels);
+	return 0;
+}
@@ -0,0 +1,8 @@
+#include <stddef.h>
+
+// Flips the BMP file 'in' into 'out' without loading the whole image:
+// 'nthreads' threads each read a strip of rows with pread(), flip it and
+// pwrite() it at the mirrored offset, so nthreads strips are in flight.
+// The strip buffers together never exceed 'budget' bytes. Sets ip from the
+// input header. Returns 0, or -1 when the budget cannot hold a single row.
+int StreamFlip(char* in, char* out, char flip, int nthreads, size_t budget);
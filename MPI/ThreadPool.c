@@ -0,0 +1,165 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ThreadPool.h"
+
+#define CHUNKS_PER_THREAD	8		// chunks dealt to each deque per job
+
+// One worker's chunks of the current job: [head, tail). The owner pops at
+// the head, thieves take from the tail, so they only meet on the last chunk.
+struct Deque {
+	pthread_mutex_t	lock;
+	long			head, tail;
+} __attribute__((aligned(64)));		// one cache line per deque
+
+static struct Deque			Deques[POOL_MAXTHREADS];
+static pthread_t			Workers[POOL_MAXTHREADS];
+static int					PoolSize;
+static pthread_barrier_t	StartBarrier, DoneBarrier;
+static PoolInit				InitFunc;
+static double				WorkerSeconds[POOL_MAXTHREADS];
+static long					WorkerItems[POOL_MAXTHREADS];
+
+// the current job, published to the workers by StartBarrier
+static PoolWork		Job;			// NULL tells the workers to exit
+static void*		JobArg;
+static long			JobItems, JobChunk;
+
+// Takes the next chunk of worker 'self', its own first, then a stolen one.
+// Returns -1 once every deque is empty; a job never adds chunks, so
+// one empty sweep means the worker is done.
+static long NextChunk(int self)
+{
+	struct Deque* d;
+	long c = -1;
+	int i;
+
+	for(i = 0; i < PoolSize && c < 0; i++)
+	{
+		d = &Deques[(self + i) % PoolSize];
+		pthread_mutex_lock(&d->lock);
+		if(d->head < d->tail) c = (i == 0) ? d->head++ : --d->tail;
+		pthread_mutex_unlock(&d->lock);
+	}
+	return c;
+}
+
+static double Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void RunChunks(int self)
+{
+	long c, first, last;
+	double start = Now();
+
+	while((c = NextChunk(self)) >= 0)
+	{
+		first = c * JobChunk;
+		last = (first + JobChunk < JobItems) ? first + JobChunk : JobItems;
+		Job(first, last, JobArg);
+		WorkerItems[self] += last - first;
+	}
+	WorkerSeconds[self] += Now() - start;
+}
+
+static void* PoolWorker(void* arg)
+{
+	int self = (int)(long)arg;
+
+	if(InitFunc != NULL) InitFunc(self, PoolSize);
+	for(;;)
+	{
+		pthread_barrier_wait(&StartBarrier);
+		if(Job == NULL) break;
+		RunChunks(self);
+		pthread_barrier_wait(&DoneBarrier);
+	}
+	return NULL;
+}
+
+int PoolStart(int nthreads, PoolInit init)
+{
+	int i, err;
+
+	if(nthreads < 1) nthreads = 1;
+	if(nthreads > POOL_MAXTHREADS) nthreads = POOL_MAXTHREADS;
+	PoolSize = nthreads;
+	InitFunc = init;
+	Job = NULL;
+	PoolResetStats();
+	pthread_barrier_init(&StartBarrier, NULL, PoolSize);
+	pthread_barrier_init(&DoneBarrier, NULL, PoolSize);
+	for(i = 0; i < PoolSize; i++)
+	{
+		pthread_mutex_init(&Deques[i].lock, NULL);
+		Deques[i].head = Deques[i].tail = 0;
+	}
+	// worker 0 is the caller
+	if(InitFunc != NULL) InitFunc(0, PoolSize);
+	for(i = 1; i < PoolSize; i++)
+	{
+		err = pthread_create(&Workers[i], NULL, PoolWorker, (void*)(long)i);
+		if(err != 0) return err;
+	}
+	return 0;
+}
+
+void PoolRun(PoolWork work, void* arg, long items)
+{
+	long nchunks;
+	int i;
+
+	if(items <= 0) return;
+	JobChunk = (items + PoolSize * CHUNKS_PER_THREAD - 1) / (PoolSize * CHUNKS_PER_THREAD);
+	nchunks = (items + JobChunk - 1) / JobChunk;
+	Job = work;
+	JobArg = arg;
+	JobItems = items;
+
+	// deal neighbouring chunks to the same worker, stealing evens out the rest
+	for(i = 0; i < PoolSize; i++)
+	{
+		Deques[i].head = nchunks * i / PoolSize;
+		Deques[i].tail = nchunks * (i + 1) / PoolSize;
+	}
+
+	pthread_barrier_wait(&StartBarrier);
+	RunChunks(0);
+	pthread_barrier_wait(&DoneBarrier);
+}
+
+void PoolStats(int self, double* seconds, long* items)
+{
+	*seconds = WorkerSeconds[self];
+	*items = WorkerItems[self];
+}
+
+void PoolResetStats(void)
+{
+	int i;
+
+	for(i = 0; i < POOL_MAXTHREADS; i++)
+	{
+		WorkerSeconds[i] = 0.0;
+		WorkerItems[i] = 0;
+	}
+}
+
+void PoolStop(void)
+{
+	int i;
+
+	Job = NULL;
+	pthread_barrier_wait(&StartBarrier);
+	for(i = 1; i < PoolSize; i++) pthread_join(Workers[i], NULL);
+	for(i = 0; i < PoolSize; i++) pthread_mutex_destroy(&Deques[i].lock);
+	pthread_barrier_destroy(&StartBarrier);
+	pthread_barrier_destroy(&DoneBarrier);
+	PoolSize = 0;
+}
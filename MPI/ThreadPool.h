@@ -0,0 +1,25 @@
+#define POOL_MAXTHREADS	128
+
+// A job handles items [first, last) of the range given to PoolRun()
+typedef void (*PoolWork)(long first, long last, void* arg);
+
+// Runs once in every worker, caller included, before its first job
+typedef void (*PoolInit)(int self, int nthreads);
+
+// Starts the persistent pool: 'nthreads' workers, the calling thread being
+// worker 0, so nthreads - 1 threads are created. They wait on a barrier
+// between jobs. 'init' may be NULL. Returns 0, or the pthread_create() error.
+int PoolStart(int nthreads, PoolInit init);
+
+// Runs work() over items [0, items) on the pool and returns once every item
+// is done. The range is cut into chunks dealt out to per-worker deques; a
+// worker whose deque runs dry steals chunks from the back of the others.
+void PoolRun(PoolWork work, void* arg, long items);
+
+// Seconds worker 'self' spent in jobs and items it ran since the last
+// PoolResetStats(); stolen chunks count for the thief
+void PoolStats(int self, double* seconds, long* items);
+void PoolResetStats(void);
+
+// Stops and joins the workers. The pool can be started again afterwards.
+void PoolStop(void);
@@ -4,6 +4,12 @@
 #include <CL/cl.h>
 #include <ctype.h>
 #include <time.h>
+#include <dirent.h>
+#include <errno.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <unistd.h>
 
 unsigned char *TheImg, *CopyImg;                  
 unsigned char *GPUImg, *GPUCopyImg, *GPUResult;
@@ -21,6 +27,44 @@ struct ImgProp {
 #define IMAGESIZE (IPHB * IPV)
 #define IMAGEPIX (IPH * IPV)
 
+// How a kernel covers the image: one work-item per pixel byte in a flat range as
+// the original kernels do, or a 2D range of 16-byte row chunks or 16-pixel groups
+enum { RANGE_PIXELS, RANGE_ROW_CHUNKS, RANGE_PIXEL_GROUPS };
+
+struct KernelInfo {
+    const char *name;
+    int range;
+} Kernels[] = {
+    { "SimpleCopy", RANGE_PIXELS },
+    { "Vflip", RANGE_PIXELS },
+    { "Hflip", RANGE_PIXELS },
+    { "VflipVec", RANGE_ROW_CHUNKS },
+    { "HflipVec", RANGE_PIXEL_GROUPS },
+};
+#define NUM_KERNELS (sizeof(Kernels) / sizeof(Kernels[0]))
+
+void print_build_log(cl_program program, cl_device_id device);
+
+void check_bmp_header(const unsigned char *h, size_t got, char *fn) {
+    //
+    // the kernels handle uncompressed 24-bit pixels right after the 54-byte header only,
+    // of which 'got' bytes were read
+    //
+    unsigned int offset = *(unsigned int*)&h[10];
+    unsigned int compression = *(unsigned int*)&h[30];
+    int bits = *(unsigned short*)&h[28];
+
+    if (got != 54 || h[0] != 'B' || h[1] != 'M') {
+        printf("%s is not a BMP file\n", fn);
+        exit(1);
+    }
+    if (bits != 24 || compression != 0 || offset != 54) {
+        printf("%s: unsupported BMP (%d bits per pixel, compression %u, pixels at byte %u), "
+               "only uncompressed 24-bit images are handled\n", fn, bits, compression, offset);
+        exit(1);
+    }
+}
+
 unsigned char *ReadBMPlin(char* fn) {
     //
     // read an image from the bmp file
@@ -36,7 +80,8 @@ unsigned char *ReadBMPlin(char* fn) {
 
     // read image information
     unsigned char HeaderInfo[54];
-    fread(HeaderInfo, sizeof(unsigned char), 54, f);  // Read the 54-byte header
+    size_t got = fread(HeaderInfo, sizeof(unsigned char), 54, f);  // Read the 54-byte header
+    check_bmp_header(HeaderInfo, got, fn);
     int width = *(int*)&HeaderInfo[18];  ip.Hpixels = width;
     int height = *(int*)&HeaderInfo[22]; ip.Vpixels = height;
     int RowBytes = (width * 3 + 3) & (~3); ip.Hbytes = RowBytes;
@@ -68,14 +113,148 @@ void WriteBMPlin(unsigned char *Img, char* fn) {
     fclose(f);
 }
 
+/*
+ * Program binary cache. Compiling kernels.cl costs more than flipping a small
+ * image, so the binary of a successful build is kept in CL_CACHE_DIR (or
+ * $IMFLIPCL_CACHE) under a hash of the kernel source, the build options, the
+ * device name and the driver version. A cached binary that fails to load or
+ * build is replaced by a fresh build from source.
+ */
+#define CL_CACHE_DIR ".clcache"
+#define CL_BUILD_OPTIONS ""
+#define CL_CACHE_MAGIC "imflipCL binary cache 1\n"
+
+int ProgramFromCache; // the last build_program() loaded a cached binary
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    while (len--) {
+        hash ^= *p++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void cache_path(char *path, size_t size, cl_device_id device, const char *source, size_t source_size) {
+    //
+    // <cache dir>/<hash of everything the binary depends on>.bin
+    //
+    char device_name[256] = "", driver[256] = "";
+    const char *dir = getenv("IMFLIPCL_CACHE") ? getenv("IMFLIPCL_CACHE") : CL_CACHE_DIR;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name) - 1, device_name, NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver) - 1, driver, NULL);
+    // the terminating zeros keep "ab" + "c" apart from "a" + "bc"
+    hash = fnv1a(hash, source, source_size);
+    hash = fnv1a(hash, "", 1);
+    hash = fnv1a(hash, CL_BUILD_OPTIONS, sizeof(CL_BUILD_OPTIONS));
+    hash = fnv1a(hash, device_name, strlen(device_name) + 1);
+    hash = fnv1a(hash, driver, strlen(driver) + 1);
+    snprintf(path, size, "%s/%016llx.bin", dir, (unsigned long long)hash);
+}
+
+cl_program load_cached_program(cl_context context, cl_device_id device, const char *path) {
+    //
+    // the program built from a cached binary, NULL if there is none or it does not fit
+    //
+    char magic[sizeof(CL_CACHE_MAGIC) - 1];
+    unsigned char *binary;
+    size_t size;
+    cl_int err, status;
+    cl_program program;
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size <= sizeof(magic) || fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+        memcmp(magic, CL_CACHE_MAGIC, sizeof(magic)) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+    size -= sizeof(magic);
+    binary = (unsigned char *)malloc(size);
+    if (!binary || fread(binary, 1, size, fp) != size) {
+        free(binary);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+
+    program = clCreateProgramWithBinary(context, 1, &device, &size, (const unsigned char **)&binary, &status, &err);
+    free(binary);
+    if (err != CL_SUCCESS)
+        return NULL;
+    if (status != CL_SUCCESS) {
+        clReleaseProgram(program); // created, but the binary does not fit the device
+        return NULL;
+    }
+    if (clBuildProgram(program, 1, &device, CL_BUILD_OPTIONS, NULL, NULL) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+void store_program(cl_program program, const char *path) {
+    //
+    // write the device binary of a built program to the cache; a failure only costs
+    // the next run a compile
+    //
+    char tmp[4200];
+    unsigned char *binary;
+    size_t size;
+    FILE *fp;
+    const char *slash = strrchr(path, '/');
+
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS || size == 0)
+        return;
+    binary = (unsigned char *)malloc(size);
+    if (!binary)
+        return;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) != CL_SUCCESS) {
+        free(binary);
+        return;
+    }
+
+    if (slash) {
+        // the cache directory and its parents
+        snprintf(tmp, sizeof(tmp), "%.*s", (int)(slash - path), path);
+        for (char *p = tmp + 1; *p; p++) {
+            if (*p == '/') {
+                *p = '\0';
+                mkdir(tmp, 0755);
+                *p = '/';
+            }
+        }
+        mkdir(tmp, 0755);
+    }
+    // written aside and renamed, so a concurrent run never reads half a binary
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    fp = fopen(tmp, "wb");
+    if (fp) {
+        int ok = fwrite(CL_CACHE_MAGIC, 1, sizeof(CL_CACHE_MAGIC) - 1, fp) == sizeof(CL_CACHE_MAGIC) - 1 &&
+                 fwrite(binary, 1, size, fp) == size;
+        if (fclose(fp) == 0 && ok)
+            rename(tmp, path);
+        else
+            remove(tmp);
+    }
+    free(binary);
+}
+
 cl_program build_program(cl_context context, cl_device_id device, const char *filename) {
     //
-    // build the argued kernel file
+    // build the argued kernel file, from the binary cache when it has a match
     //
 
     FILE *fp;
     char *source_str;
     size_t source_size;
+    char path[4096];
 
     fp = fopen(filename, "r");
     if (!fp) {
@@ -91,8 +270,16 @@ cl_program build_program(cl_context context, cl_device_id device, const char *fi
     source_str[source_size] = '\0';
     fclose(fp);
 
+    cache_path(path, sizeof(path), device, source_str, source_size);
+    cl_program program = load_cached_program(context, device, path);
+    ProgramFromCache = program != NULL;
+    if (program) {
+        free(source_str);
+        return program;
+    }
+
     cl_int err;
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source_str, (const size_t *)&source_size, &err);
+    program = clCreateProgramWithSource(context, 1, (const char **)&source_str, (const size_t *)&source_size, &err);
     free(source_str);
 
     if (err != CL_SUCCESS) {
@@ -100,12 +287,13 @@ cl_program build_program(cl_context context, cl_device_id device, const char *fi
         exit(1);
     }
 
-    err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
+    err = clBuildProgram(program, 1, &device, CL_BUILD_OPTIONS, NULL, NULL);
     if (err != CL_SUCCESS) {
         print_build_log(program, device);
         printf("Error: Failed to build program!\n");
         exit(1);
     }
+    store_program(program, path);
 
     return program;
 }
@@ -144,14 +332,12 @@ void print_build_log(cl_program program, cl_device_id device) {
     free(log);
 }
 
-void execute_kernel(cl_command_queue queue, cl_kernel kernel, cl_mem input_img, cl_mem output_img, size_t global_size, size_t local_size) {
+double execute_kernel(cl_command_queue queue, cl_kernel kernel, size_t *global_work_size, size_t *local_work_size) {
     //
     // execute the target opencl kernel with the desired command queue and arguments
+    // on a 2D range, returns the kernel time in ms
     //
     cl_int err;
-    
-    size_t global_work_size[2] = {global_size, 1};
-    size_t local_work_size[2] = {local_size, 1};
 
     cl_event event;
     err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, &event);
@@ -167,12 +353,305 @@ void execute_kernel(cl_command_queue queue, cl_kernel kernel, cl_mem input_img,
         printf("Error: Failed to execute kernel\n");
         exit(1);
     }
+    clReleaseEvent(event);
     // clFinish(queue);
+    return (time_end - time_start) / 1e6;
+}
+
+void work_size(int range, size_t local_size, size_t *global_work_size, size_t *local_work_size) {
+    //
+    // the NDRange of a kernel for the current image, dimension 0 rounded up to
+    // a multiple of the local size
+    //
+    size_t items;
+
+    switch (range) {
+    case RANGE_ROW_CHUNKS:
+        items = (IPHB + 15) / 16;
+        break;
+    case RANGE_PIXEL_GROUPS:
+        items = (IPH + 15) / 16;
+        break;
+    default:
+        // image size * 3 for the case of the image copy
+        global_work_size[0] = IMAGEPIX * 3;
+        global_work_size[1] = 1;
+        local_work_size[0] = local_size;
+        local_work_size[1] = 1;
+        return;
+    }
+    global_work_size[0] = (items + local_size - 1) / local_size * local_size;
+    global_work_size[1] = IPV;
+    local_work_size[0] = local_size;
+    local_work_size[1] = 1;
+}
+
+/*
+ * Batch mode (-B): many images through a ring of BATCH_RING preallocated
+ * buffer slots and three in-order command queues, one each for uploads,
+ * kernels and downloads. A kernel waits on its image's upload event and a
+ * download on its kernel's, so while image N computes, image N+1 uploads
+ * and image N-1 downloads. A slot is reused once its previous image is
+ * downloaded and written out.
+ */
+#define BATCH_RING 3
+
+struct BatchSlot {
+    cl_mem in, out;                   // device buffers, sized for the largest image
+    cl_mem pinnedIn, pinnedOut;       // page-locked host buffers behind hostIn/hostOut
+    unsigned char *hostIn, *hostOut;  // mapped once for the whole batch
+    struct ImgProp props;
+    cl_event upload, kernel, download;
+    int image;                        // index in the batch, -1 when free
+};
+
+char **BatchInputs;
+int BatchCount;
+
+void add_batch_input(const char *path, int *cap) {
+    if (BatchCount == *cap) {
+        *cap = *cap ? 2 * *cap : 64;
+        BatchInputs = (char **)realloc(BatchInputs, *cap * sizeof(char *));
+        if (BatchInputs == NULL) {
+            printf("Unable to allocate the image list\n");
+            exit(1);
+        }
+    }
+    BatchInputs[BatchCount++] = strdup(path);
+}
+
+int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void list_batch_inputs(char *input) {
+    //
+    // the *.bmp files of a directory, or the lines of a list file
+    //
+    char path[4096];
+    struct dirent *e;
+    size_t len;
+    int cap = 0;
+    DIR *dir = opendir(input);
+    FILE *f;
+
+    if (dir != NULL) {
+        while ((e = readdir(dir)) != NULL) {
+            len = strlen(e->d_name);
+            if (len > 4 && strcasecmp(e->d_name + len - 4, ".bmp") == 0) {
+                snprintf(path, sizeof(path), "%s/%s", input, e->d_name);
+                add_batch_input(path, &cap);
+            }
+        }
+        closedir(dir);
+        qsort(BatchInputs, BatchCount, sizeof(char *), compare_names);
+        return;
+    }
+    f = fopen(input, "r");
+    if (f == NULL) {
+        printf("Unable to open file at %s\n", input);
+        exit(1);
+    }
+    while (fgets(path, sizeof(path), f) != NULL) {
+        path[strcspn(path, "\r\n")] = '\0';
+        if (path[0] != '\0')
+            add_batch_input(path, &cap);
+    }
+    fclose(f);
+}
+
+void read_bmp_into(char *fn, unsigned char *buf, size_t cap, struct ImgProp *props) {
+    //
+    // read an image into a preallocated buffer, or only its header with a NULL buffer
+    //
+    FILE *f = fopen(fn, "rb");
+    if (f == NULL) {
+        printf("Unable to open file at %s\n", fn);
+        exit(1);
+    }
+    check_bmp_header(props->HeaderInfo, fread(props->HeaderInfo, sizeof(unsigned char), 54, f),
+                     fn);
+    props->Hpixels = *(int*)&props->HeaderInfo[18];
+    props->Vpixels = *(int*)&props->HeaderInfo[22];
+    props->Hbytes = (props->Hpixels * 3 + 3) & (~3);
+    if (buf != NULL) {
+        if (props->Hbytes * props->Vpixels > cap) {
+            printf("Image %s grew while the batch ran\n", fn);
+            exit(1);
+        }
+        fread(buf, sizeof(unsigned char), props->Hbytes * props->Vpixels, f);
+    }
+    fclose(f);
+}
+
+double event_ms(cl_event event) {
+    cl_ulong time_start, time_end;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+    return (time_end - time_start) / 1e6;
+}
+
+unsigned char *map_pinned(cl_context context, cl_command_queue queue, size_t bytes,
+                          cl_map_flags flags, cl_mem *buffer) {
+    //
+    // a host buffer the driver allocates page-locked, mapped once; transfers from pageable
+    // malloc memory are staged synchronously by most drivers and would not overlap kernels
+    //
+    cl_int err;
+    unsigned char *p;
+
+    *buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL,
+                             &err);
+    if (err != CL_SUCCESS)
+        return NULL;
+    p = (unsigned char *)clEnqueueMapBuffer(queue, *buffer, CL_TRUE, flags, 0, bytes, 0, NULL,
+                                            NULL, &err);
+    return err == CL_SUCCESS ? p : NULL;
+}
+
+void finish_slot(struct BatchSlot *slot, char *outDir, double *stage_ms) {
+    //
+    // wait for the slot's download, write the image out and account its events
+    //
+    char out[4096];
+    const char *base = strrchr(BatchInputs[slot->image], '/');
+
+    clWaitForEvents(1, &slot->download);
+    stage_ms[0] += event_ms(slot->upload);
+    stage_ms[1] += event_ms(slot->kernel);
+    stage_ms[2] += event_ms(slot->download);
+    clReleaseEvent(slot->upload);
+    clReleaseEvent(slot->kernel);
+    clReleaseEvent(slot->download);
+
+    ip = slot->props;
+    snprintf(out, sizeof(out), "%s/%s", outDir, base ? base + 1 : BatchInputs[slot->image]);
+    WriteBMPlin(slot->hostOut, out);
+    slot->image = -1;
+}
+
+void run_batch(cl_context context, cl_device_id device, cl_kernel kernel, int range,
+               size_t local_size, char *input, char *outDir) {
+    struct BatchSlot ring[BATCH_RING];
+    struct ImgProp props;
+    cl_command_queue queues[3]; // upload, kernel, download
+    size_t global_work_size[2], local_work_size[2], maxBytes = 0;
+    double stage_ms[3] = {0, 0, 0}, bytes = 0, elapsed;
+    struct timespec t0, t1;
+    unsigned int h_pixels, v_pixels;
+    cl_int err, err_out;
+    int i, q;
+
+    list_batch_inputs(input);
+    if (mkdir(outDir, 0755) != 0 && errno != EEXIST) {
+        printf("Unable to create directory %s\n", outDir);
+        exit(1);
+    }
+    if (BatchCount == 0) {
+        printf("Batch of 0 images, nothing to do\n");
+        free(BatchInputs);
+        return;
+    }
+    // the buffers are sized once, for the largest image
+    for (i = 0; i < BatchCount; i++) {
+        read_bmp_into(BatchInputs[i], NULL, 0, &props);
+        if (props.Hbytes * props.Vpixels > maxBytes)
+            maxBytes = props.Hbytes * props.Vpixels;
+    }
+    printf("Batch of %d images, %d buffer slots of %lu bytes, 3 command queues, "
+           "pinned host buffers\n", BatchCount, BATCH_RING, (unsigned long)maxBytes);
+
+    for (q = 0; q < 3; q++) {
+        queues[q] = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to create command queue\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < BATCH_RING; i++) {
+        ring[i].in = clCreateBuffer(context, CL_MEM_READ_ONLY, maxBytes, NULL, &err);
+        ring[i].out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, maxBytes, NULL, &err_out);
+        ring[i].hostIn = map_pinned(context, queues[0], maxBytes, CL_MAP_WRITE, &ring[i].pinnedIn);
+        ring[i].hostOut = map_pinned(context, queues[2], maxBytes, CL_MAP_READ,
+                                     &ring[i].pinnedOut);
+        ring[i].image = -1;
+        if (err != CL_SUCCESS || err_out != CL_SUCCESS || ring[i].hostIn == NULL ||
+            ring[i].hostOut == NULL) {
+            printf("Error: Failed to create buffer\n");
+            exit(1);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BatchCount; i++) {
+        struct BatchSlot *slot = &ring[i % BATCH_RING];
+        if (slot->image >= 0)
+            finish_slot(slot, outDir, stage_ms); // its buffers are free after this
+
+        read_bmp_into(BatchInputs[i], slot->hostIn, maxBytes, &slot->props);
+        slot->image = i;
+        ip = slot->props;
+        bytes += IMAGESIZE;
+
+        err = clEnqueueWriteBuffer(queues[0], slot->in, CL_FALSE, 0, IMAGESIZE, slot->hostIn,
+                                   0, NULL, &slot->upload);
+        // the arguments are captured when the kernel is enqueued
+        h_pixels = IPH;
+        v_pixels = IPV;
+        err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &slot->out);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &slot->in);
+        err |= clSetKernelArg(kernel, 2, sizeof(unsigned int), &h_pixels);
+        err |= clSetKernelArg(kernel, 3, sizeof(unsigned int), &v_pixels);
+        work_size(range, local_size, global_work_size, local_work_size);
+        err |= clEnqueueNDRangeKernel(queues[1], kernel, 2, NULL, global_work_size, local_work_size,
+                                      1, &slot->upload, &slot->kernel);
+        err |= clEnqueueReadBuffer(queues[2], slot->out, CL_FALSE, 0, IMAGESIZE, slot->hostOut,
+                                   1, &slot->kernel, &slot->download);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to enqueue image %s\n", BatchInputs[i]);
+            exit(1);
+        }
+        for (q = 0; q < 3; q++)
+            clFlush(queues[q]);
+    }
+    // drain the ring in batch order
+    for (i = BatchCount > BATCH_RING ? BatchCount - BATCH_RING : 0; i < BatchCount; i++)
+        finish_slot(&ring[i % BATCH_RING], outDir, stage_ms);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    printf("Batch time: %f ms for %d images   %.2f images/s   %.2f MB/s\n",
+           elapsed * 1000, BatchCount, BatchCount / elapsed, bytes / elapsed / (1024.0 * 1024.0));
+    printf("Device time per image: upload %f ms   kernel %f ms   download %f ms\n",
+           BatchCount ? stage_ms[0] / BatchCount : 0.0, BatchCount ? stage_ms[1] / BatchCount : 0.0,
+           BatchCount ? stage_ms[2] / BatchCount : 0.0);
+    printf("Stage sum %f ms over %f ms of wall time (includes the file I/O)\n",
+           stage_ms[0] + stage_ms[1] + stage_ms[2], elapsed * 1000);
+
+    for (i = 0; i < BATCH_RING; i++) {
+        clEnqueueUnmapMemObject(queues[0], ring[i].pinnedIn, ring[i].hostIn, 0, NULL, NULL);
+        clEnqueueUnmapMemObject(queues[2], ring[i].pinnedOut, ring[i].hostOut, 0, NULL, NULL);
+    }
+    for (q = 0; q < 3; q++)
+        clFinish(queues[q]);
+    for (i = 0; i < BATCH_RING; i++) {
+        clReleaseMemObject(ring[i].in);
+        clReleaseMemObject(ring[i].out);
+        clReleaseMemObject(ring[i].pinnedIn);
+        clReleaseMemObject(ring[i].pinnedOut);
+    }
+    for (q = 0; q < 3; q++)
+        clReleaseCommandQueue(queues[q]);
+    for (i = 0; i < BatchCount; i++)
+        free(BatchInputs[i]);
+    free(BatchInputs);
 }
 
 int main(int argc, char **argv) {
 
-    size_t global_size, local_size = 256;
+    size_t global_work_size[2], local_work_size[2], local_size = 256;
+    double kernel_ms;
+    int k;
     local_size = 512;
     char kernel_name[256];
 
@@ -184,10 +663,18 @@ int main(int argc, char **argv) {
     cl_program program;
     cl_kernel kernel;
     cl_mem input_img_buffer, output_img_buffer;
+    int batch = 0;
 
     // Argument parsing
+    if (argc > 1 && strcmp(argv[1], "-B") == 0) {
+        batch = 1;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
     if (argc < 5) {
         printf("Usage: %s InputFilename OutputFilename [Kernel Name] [Local Size]\n", argv[0]);
+        printf("       %s -B InputDirectory|ListFile OutputDirectory [Kernel Name] [Local Size]\n", argv[0]);
         exit(1);
     }
     char InputFileName[255], OutputFileName[255];
@@ -195,11 +682,21 @@ int main(int argc, char **argv) {
     strcpy(OutputFileName, argv[2]);
     strncpy(kernel_name, argv[3], sizeof(kernel_name) - 1);
     local_size = atoi(argv[4]);
+    for (k = 0; k < (int)NUM_KERNELS && strcmp(Kernels[k].name, kernel_name) != 0; k++)
+        ;
+    if (k == NUM_KERNELS) {
+        printf("Unknown kernel %s, one of:", kernel_name);
+        for (k = 0; k < (int)NUM_KERNELS; k++)
+            printf(" %s", Kernels[k].name);
+        printf("\n");
+        exit(1);
+    }
 
     printf("Input: %s\nOutput: %s\nKernel: %s\nLocal Size: %d\n",
         InputFileName, OutputFileName, kernel_name, local_size);
 
     // Read input image
+    if (!batch) {
     TheImg = ReadBMPlin(InputFileName);
     if (TheImg == NULL) {
         printf("Cannot allocate memory for the source image!\n");
@@ -211,14 +708,21 @@ int main(int argc, char **argv) {
         printf("Cannot allocate memory for the destination image!\n");
         exit(1);
     }
+    }
 
     // Initialize OpenCL platform and device
+    struct timespec startup_start, build_start, build_end;
+    clock_gettime(CLOCK_MONOTONIC, &startup_start);
     err = clGetPlatformIDs(1, &platform, NULL);
     if (err != CL_SUCCESS) {
         printf("Error: Failed to get platform ID\n");
         exit(1);
     }
     err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+    if (err == CL_DEVICE_NOT_FOUND) {
+        // no GPU, e.g. a CPU runtime such as PoCL
+        err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, NULL);
+    }
     if (err != CL_SUCCESS) {
         printf("Error: Failed to get device ID\n");
         exit(1);
@@ -238,12 +742,29 @@ int main(int argc, char **argv) {
     }
 
     // Build the OpenCL program and use argued kernel
+    clock_gettime(CLOCK_MONOTONIC, &build_start);
     program = build_program(context, device, "kernels.cl");
+    clock_gettime(CLOCK_MONOTONIC, &build_end);
+    printf("Program build took %f ms (%s)\n",
+           (build_end.tv_sec - build_start.tv_sec) * 1e3 + (build_end.tv_nsec - build_start.tv_nsec) / 1e6,
+           ProgramFromCache ? "cached binary" : "compiled from source");
     kernel = clCreateKernel(program, kernel_name, &err);
     if (err != CL_SUCCESS) {
         printf("Error: Failed to create kernel\n");
         exit(1);
     }
+    clock_gettime(CLOCK_MONOTONIC, &build_end);
+    printf("OpenCL startup took %f ms (platform, context, queue, program, kernel)\n",
+           (build_end.tv_sec - startup_start.tv_sec) * 1e3 + (build_end.tv_nsec - startup_start.tv_nsec) / 1e6);
+
+    if (batch) {
+        run_batch(context, device, kernel, Kernels[k].range, local_size, InputFileName, OutputFileName);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+        clReleaseCommandQueue(queue);
+        clReleaseContext(context);
+        return 0;
+    }
 
     clock_t start, end;
     double time_used;
@@ -273,13 +794,14 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
-    // image size * 3 for the case of the image copy
-    global_size = IMAGEPIX * 3;
+    work_size(Kernels[k].range, local_size, global_work_size, local_work_size);
 
     start = clock();
 
     // Execute the kernel
-    execute_kernel(queue, kernel, input_img_buffer, output_img_buffer, global_size, local_size);
+    kernel_ms = execute_kernel(queue, kernel, global_work_size, local_work_size);
+    // every image byte is read once and written once
+    printf("Kernel Throughput: %.2f GB/s\n", 2.0 * IMAGESIZE / (kernel_ms * 1e6));
 
     end = clock();
     time_used = ((double) (end - start) / CLOCKS_PER_SEC);
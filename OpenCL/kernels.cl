@@ -98,3 +98,112 @@ __kernel void Hflip(__global uchar* ImgDst,
     ImgDst[MYdstIndex + 1] = ImgSrc[MYsrcIndex + 1];
     ImgDst[MYdstIndex + 2] = ImgSrc[MYsrcIndex + 2];
 }
+
+/*
+ * Vectorized variants. The kernels above move one pixel per work-item with
+ * three byte loads and stores and find their row and column with divisions.
+ * These run on a 2D NDRange, dimension 1 being the row, and every work-item
+ * moves 16 bytes at a time with vload16/vstore16, so neighbouring work-items
+ * touch neighbouring 16-byte chunks of a row.
+ */
+
+// Byte shuffles reversing 16 BGR pixels (48 bytes) into three 16-byte vectors;
+// output vector k takes its bytes from the 32 source bytes starting at 16, 8, 0
+#define HFLIP_MASK0 (uchar16)(29, 30, 31, 26, 27, 28, 23, 24, 25, 20, 21, 22, 17, 18, 19, 14)
+#define HFLIP_MASK1 (uchar16)(23, 24, 19, 20, 21, 16, 17, 18, 13, 14, 15, 10, 11, 12, 7, 8)
+#define HFLIP_MASK2 (uchar16)(17, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2)
+
+__kernel void VflipVec(__global uchar* ImgDst,
+                       __global uchar* ImgSrc,
+                       const uint Hpixels,
+                       const uint Vpixels)
+{
+    // Vertical flip as a copy of 16-byte row chunks: work-item (x, y) moves
+    // bytes [16x, 16x + 16) of row y to the mirrored row, padding included
+    //
+    // Arguments:
+    // ----------
+    // ImgDst (uchar pointer): the location to store the flipped pixels
+    // ImgSrc (uchar pointer): the location to the the pixel values
+    // Hpixels (uint): the number of horizontal pixels
+    // VPixels (uint): the number of vertical pixels
+    //
+    // NDRange: (ceil(RowBytes / 16), Vpixels)
+    //
+    // Returns:
+    // --------
+    // void
+    uint RowBytes = (Hpixels * 3 + 3) & (~3);
+    uint MYoffset = get_global_id(0) * 16;
+    uint MYrow = get_global_id(1);
+
+    if (MYrow >= Vpixels || MYoffset >= RowBytes)
+        return;
+
+    __global uchar *src = ImgSrc + MYrow * RowBytes + MYoffset;
+    __global uchar *dst = ImgDst + (Vpixels - 1 - MYrow) * RowBytes + MYoffset;
+
+    if (MYoffset + 16 <= RowBytes) {
+        vstore16(vload16(0, src), 0, dst);
+    } else {
+        // the last chunk of a row, RowBytes is a multiple of 4
+        for (uint i = 0; i < RowBytes - MYoffset; i += 4)
+            vstore4(vload4(0, src + i), 0, dst + i);
+    }
+}
+
+__kernel void HflipVec(__global uchar* ImgDst,
+                       __global uchar* ImgSrc,
+                       const uint Hpixels,
+                       const uint Vpixels)
+{
+    // Horizontal flip, 16 pixels per work-item: work-item (x, y) writes
+    // pixels [16x, 16x + 16) of row y, reading the 48 mirrored source bytes
+    // as overlapping 16-byte vectors and reversing the BGR triplets in
+    // registers with shuffle2. The last work-item of a row takes the pixels
+    // left over and copies the row padding
+    //
+    // Arguments:
+    // ----------
+    // ImgDst (uchar pointer): the location to store the flipped pixels
+    // ImgSrc (uchar pointer): the location to the the pixel values
+    // Hpixels (uint): the number of horizontal pixels
+    // VPixels (uint): the number of vertical pixels
+    //
+    // NDRange: (ceil(Hpixels / 16), Vpixels)
+    //
+    // Returns:
+    // --------
+    // void
+    uint RowBytes = (Hpixels * 3 + 3) & (~3);
+    uint MYcol = get_global_id(0) * 16;
+    uint MYrow = get_global_id(1);
+
+    if (MYrow >= Vpixels || MYcol >= Hpixels)
+        return;
+
+    __global uchar *row = ImgSrc + MYrow * RowBytes;
+    __global uchar *dst = ImgDst + MYrow * RowBytes + 3 * MYcol;
+
+    if (MYcol + 16 <= Hpixels) {
+        // source pixels [Hpixels - MYcol - 16, Hpixels - MYcol), reversed
+        __global uchar *src = row + 3 * (Hpixels - MYcol - 16);
+        uchar16 a = vload16(0, src);
+        uchar16 b = vload16(0, src + 16);
+        uchar16 c = vload16(0, src + 32);
+        vstore16(shuffle2(b, c, HFLIP_MASK0), 0, dst);
+        vstore16(shuffle2(vload16(0, src + 8), vload16(0, src + 24), HFLIP_MASK1), 0, dst + 16);
+        vstore16(shuffle2(a, b, HFLIP_MASK2), 0, dst + 32);
+    } else {
+        for (uint i = 0; i < Hpixels - MYcol; i++) {
+            __global uchar *s = row + 3 * (Hpixels - 1 - MYcol - i);
+            dst[3 * i] = s[0];
+            dst[3 * i + 1] = s[1];
+            dst[3 * i + 2] = s[2];
+        }
+    }
+    if (MYcol + 16 >= Hpixels) {
+        for (uint i = 3 * Hpixels; i < RowBytes; i++)
+            ImgDst[MYrow * RowBytes + i] = row[i];
+    }
+}
@@ -0,0 +1,357 @@
+#include "Batch.h"
+#include "ImageFlip.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// One image on its way through the pipeline
+struct BatchJob {
+  char *in, *out;
+  struct ImgProp props; // the image's own, ip only describes the one flipped
+  unsigned char **img;
+};
+
+// Bounded FIFO of jobs between two stages
+struct Queue {
+  struct BatchJob *slots[BATCH_QUEUE_DEPTH];
+  int head, count, closed;
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty, notFull;
+};
+
+static struct Queue FlipQ, WriteQ;
+static char **Inputs;
+static int NumInputs, NextInput, ReadersLeft;
+static char *Skipped; // per input: could not be read
+static char *OutDir;
+static pthread_mutex_t InputLock = PTHREAD_MUTEX_INITIALIZER;
+static double ReadBusy, WriteBusy; // seconds, summed over the threads
+static double BytesWritten;        // pixel data
+
+static double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void QueueInit(struct Queue *q) {
+  memset(q->slots, 0, sizeof(q->slots));
+  q->head = q->count = q->closed = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->notEmpty, NULL);
+  pthread_cond_init(&q->notFull, NULL);
+}
+
+static void QueueDestroy(struct Queue *q) {
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->notEmpty);
+  pthread_cond_destroy(&q->notFull);
+}
+
+// Blocks while the queue is full
+static void QueuePush(struct Queue *q, struct BatchJob *job) {
+  pthread_mutex_lock(&q->lock);
+  while (q->count == BATCH_QUEUE_DEPTH) {
+    pthread_cond_wait(&q->notFull, &q->lock);
+  }
+  q->slots[(q->head + q->count) % BATCH_QUEUE_DEPTH] = job;
+  q->count++;
+  pthread_cond_signal(&q->notEmpty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// Blocks while the queue is empty; NULL once it is empty and closed
+static struct BatchJob *QueuePop(struct Queue *q) {
+  struct BatchJob *job = NULL;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0 && !q->closed) {
+    pthread_cond_wait(&q->notEmpty, &q->lock);
+  }
+  if (q->count > 0) {
+    job = q->slots[q->head];
+    q->head = (q->head + 1) % BATCH_QUEUE_DEPTH;
+    q->count--;
+    pthread_cond_signal(&q->notFull);
+  }
+  pthread_mutex_unlock(&q->lock);
+  return job;
+}
+
+// No more pushes: wakes every consumer waiting on an empty queue
+static void QueueClose(struct Queue *q) {
+  pthread_mutex_lock(&q->lock);
+  q->closed = 1;
+  pthread_cond_broadcast(&q->notEmpty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static int CompareNames(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static const char *BaseName(const char *path) {
+  const char *base = strrchr(path, '/');
+  return base ? base + 1 : path;
+}
+
+static int CompareBaseNames(const void *a, const void *b) {
+  return strcmp(BaseName(*(char *const *)a), BaseName(*(char *const *)b));
+}
+
+// The outputs take the inputs' file names, so two list entries with the same
+// file name, e.g. a/x.bmp and b/x.bmp, would overwrite each other
+static int CheckOutputNames() {
+  char **sorted = (char **)malloc((NumInputs + 1) * sizeof(char *));
+  int i, dup = 0;
+
+  if (sorted == NULL) {
+    printf("\n\nCannot allocate the batch list\n\n");
+    exit(1);
+  }
+  memcpy(sorted, Inputs, NumInputs * sizeof(char *));
+  qsort(sorted, NumInputs, sizeof(char *), CompareBaseNames);
+  for (i = 1; i < NumInputs && !dup; i++) {
+    if (strcmp(BaseName(sorted[i - 1]), BaseName(sorted[i])) == 0) {
+      printf("\n\n%s and %s would both be written as %s\n\n", sorted[i - 1],
+             sorted[i], BaseName(sorted[i]));
+      dup = 1;
+    }
+  }
+  free(sorted);
+  return dup ? -1 : 0;
+}
+
+static void AddInput(const char *path, int *cap) {
+  if (NumInputs == *cap) {
+    *cap = *cap ? 2 * *cap : 64;
+    Inputs = (char **)realloc(Inputs, *cap * sizeof(char *));
+    if (Inputs == NULL) {
+      printf("\n\nCannot allocate the batch list\n\n");
+      exit(1);
+    }
+  }
+  Inputs[NumInputs++] = strdup(path);
+}
+
+// Fills Inputs from a directory of BMPs or from a list file, whose entries
+// must have distinct file names
+static int ListInputs(char *input) {
+  char path[4096];
+  struct dirent *e;
+  size_t len;
+  int cap = 0;
+  DIR *dir = opendir(input);
+
+  if (dir != NULL) {
+    while ((e = readdir(dir)) != NULL) {
+      len = strlen(e->d_name);
+      if (len > 4 && strcasecmp(e->d_name + len - 4, ".bmp") == 0) {
+        snprintf(path, sizeof(path), "%s/%s", input, e->d_name);
+        AddInput(path, &cap);
+      }
+    }
+    closedir(dir);
+    qsort(Inputs, NumInputs, sizeof(char *), CompareNames);
+    return 0;
+  }
+
+  FILE *f = fopen(input, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  while (fgets(path, sizeof(path), f) != NULL) {
+    path[strcspn(path, "\r\n")] = '\0';
+    if (path[0] != '\0') {
+      AddInput(path, &cap);
+    }
+  }
+  fclose(f);
+  return CheckOutputNames();
+}
+
+// outDir/<file name of in>
+static char *OutputPath(const char *in) {
+  const char *base = BaseName(in);
+  size_t len;
+  char *out;
+
+  len = strlen(OutDir) + strlen(base) + 2;
+  out = (char *)malloc(len);
+  if (out != NULL) {
+    snprintf(out, len, "%s/%s", OutDir, base);
+  }
+  return out;
+}
+
+// Reader stage: claims the next input until there are none left; an input
+// that cannot be read is skipped and reported once the batch is done
+static void *Reader(void *arg) {
+  struct BatchJob *job;
+  double start, busy = 0.0;
+  int i;
+
+  (void)arg;
+  for (;;) {
+    pthread_mutex_lock(&InputLock);
+    i = NextInput++;
+    pthread_mutex_unlock(&InputLock);
+    if (i >= NumInputs) {
+      break;
+    }
+    job = (struct BatchJob *)calloc(1, sizeof(struct BatchJob));
+    if (job == NULL) {
+      printf("\n\nCannot allocate a batch job\n\n");
+      exit(1);
+    }
+    start = Now();
+    job->in = Inputs[i];
+    job->out = OutputPath(job->in);
+    if (job->out == NULL) {
+      printf("\n\nCannot allocate %s ... Exiting ...\n\n", job->in);
+      exit(1);
+    }
+    job->img = ReadBMPProps(job->in, &job->props);
+    busy += Now() - start;
+    if (job->img == NULL) {
+      printf("Skipping %s\n", job->in);
+      Skipped[i] = 1;
+      free(job->out);
+      free(job);
+      continue;
+    }
+    QueuePush(&FlipQ, job);
+  }
+
+  // the last reader out closes the flip queue
+  pthread_mutex_lock(&InputLock);
+  ReadBusy += busy;
+  if (--ReadersLeft == 0) {
+    QueueClose(&FlipQ);
+  }
+  pthread_mutex_unlock(&InputLock);
+  return NULL;
+}
+
+// Writer stage: drains the write queue until the flip stage closes it
+static void *Writer(void *arg) {
+  struct BatchJob *job;
+  double start, busy = 0.0, bytes = 0.0;
+
+  (void)arg;
+  while ((job = QueuePop(&WriteQ)) != NULL) {
+    start = Now();
+    WriteBMPProps(job->img, &job->props, job->out);
+    busy += Now() - start;
+    bytes += (double)job->props.Hbytes * job->props.Vpixels;
+    FreeImage(job->img);
+    free(job->out);
+    free(job);
+  }
+
+  pthread_mutex_lock(&InputLock);
+  WriteBusy += busy;
+  BytesWritten += bytes;
+  pthread_mutex_unlock(&InputLock);
+  return NULL;
+}
+
+int RunBatch(char *input, char *outDir, void (*flip)(unsigned char **img),
+             int readers, int writers) {
+  pthread_t *th;
+  struct BatchJob *job;
+  double start, elapsed, flipStart, flipBusy = 0.0;
+  int i, images = 0, skipped = 0;
+
+  if (ListInputs(input) != 0) {
+    return -1;
+  }
+  Skipped = (char *)calloc(NumInputs + 1, 1);
+  if (Skipped == NULL) {
+    printf("\n\nCannot allocate the batch list\n\n");
+    exit(1);
+  }
+  if (mkdir(outDir, 0755) != 0 && errno != EEXIST) {
+    printf("\n\nCannot create the output directory %s\n\n", outDir);
+    exit(1);
+  }
+  OutDir = outDir;
+  NextInput = 0;
+  ReadersLeft = readers;
+  ReadBusy = WriteBusy = BytesWritten = 0.0;
+  QueueInit(&FlipQ);
+  QueueInit(&WriteQ);
+  printf("\nBatch of %d images: %d readers, 1 flipper, %d writers, queues of "
+         "%d\n",
+         NumInputs, readers, writers, BATCH_QUEUE_DEPTH);
+
+  th = (pthread_t *)malloc((readers + writers) * sizeof(pthread_t));
+  if (th == NULL) {
+    printf("\n\nCannot allocate the batch threads\n\n");
+    exit(1);
+  }
+  start = Now();
+  for (i = 0; i < readers + writers; i++) {
+    if (pthread_create(&th[i], NULL, i < readers ? Reader : Writer, NULL) !=
+        0) {
+      printf("\nThread Creation Error. Exiting abruptly... \n");
+      exit(1);
+    }
+  }
+
+  // flip stage: ip describes the image being flipped, for the kernels
+  while ((job = QueuePop(&FlipQ)) != NULL) {
+    flipStart = Now();
+    ip = job->props;
+    (*flip)(job->img);
+    flipBusy += Now() - flipStart;
+    images++;
+    QueuePush(&WriteQ, job);
+  }
+  QueueClose(&WriteQ);
+
+  for (i = 0; i < readers + writers; i++) {
+    pthread_join(th[i], NULL);
+  }
+  elapsed = Now() - start;
+
+  printf("\nBatch time: %9.4f ms for %d images   %8.2f images/s   %8.2f "
+         "MB/s",
+         elapsed * 1000.0, images, images / elapsed,
+         BytesWritten / elapsed / (1024.0 * 1024.0));
+  printf("\nBusy time:  read %9.4f ms   flip %9.4f ms   write %9.4f ms "
+         "(summed over each stage's threads)\n",
+         ReadBusy * 1000.0, flipBusy * 1000.0, WriteBusy * 1000.0);
+
+  for (i = 0; i < NumInputs; i++) {
+    skipped += Skipped[i];
+  }
+  if (skipped > 0) {
+    printf("\n%d of %d images could not be read and were skipped:\n", skipped,
+           NumInputs);
+    for (i = 0; i < NumInputs; i++) {
+      if (Skipped[i]) {
+        printf("  %s\n", Inputs[i]);
+      }
+    }
+  }
+
+  free(th);
+  QueueDestroy(&FlipQ);
+  QueueDestroy(&WriteQ);
+  for (i = 0; i < NumInputs; i++) {
+    free(Inputs[i]);
+  }
+  free(Inputs);
+  free(Skipped);
+  Skipped = NULL;
+  Inputs = NULL;
+  NumInputs = 0;
+  return images;
+}
@@ -0,0 +1,25 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_QUEUE_DEPTH 4 // images waiting between two stages
+
+/**
+ * RunBatch - Flips every BMP of 'input' into the directory 'outDir', under
+ * the same file names, through a three-stage pipeline: 'readers' threads read
+ * images, the calling thread flips them with 'flip' (using the OpenMP threads
+ * that are set) and 'writers' threads write them out. The stages hand images
+ * over through bounded queues, so reading image N+1 and writing image N-1
+ * overlap the flip of image N while at most readers + writers + 2 *
+ * BATCH_QUEUE_DEPTH + 1 images are in memory. Prints images/s and MB/s.
+ * Inputs that cannot be read are skipped and listed at the end.
+ *
+ * @param input: a directory, whose *.bmp files are flipped, or a text file
+ *               listing one input path per line. The listed files must have
+ *               distinct file names, as they keep them in 'outDir'.
+ * @param flip: one of the in-place flips of ImageFlip.h.
+ * @return: the number of images flipped, -1 if 'input' cannot be listed.
+ */
+int RunBatch(char *input, char *outDir, void (*flip)(unsigned char **img),
+             int readers, int writers);
+
+#endif
@@ -0,0 +1,82 @@
+#include "BenchStats.h"
+#include <math.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_LLC (32 << 20) // when the LLC size cannot be queried
+
+static volatile unsigned char BenchSink;
+
+double BenchNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of n sorted samples
+static double Percentile(const double *sorted, int n, double p) {
+  int rank = (int)ceil(p * n);
+  return sorted[rank < 1 ? 0 : rank - 1];
+}
+
+void BenchSummarize(double *samples, int n, struct BenchStats *s) {
+  double sum = 0.0, sq = 0.0;
+  int i;
+
+  memset(s, 0, sizeof(*s));
+  s->n = n;
+  if (n <= 0) {
+    return;
+  }
+  qsort(samples, n, sizeof(double), CompareDoubles);
+  for (i = 0; i < n; i++) {
+    sum += samples[i];
+  }
+  s->mean = sum / n;
+  for (i = 0; i < n; i++) {
+    sq += (samples[i] - s->mean) * (samples[i] - s->mean);
+  }
+  s->stddev = (n > 1) ? sqrt(sq / (n - 1)) : 0.0;
+  s->min = samples[0];
+  s->max = samples[n - 1];
+  s->median = (n % 2) ? samples[n / 2]
+                      : (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+  s->p95 = Percentile(samples, n, 0.95);
+  s->p99 = Percentile(samples, n, 0.99);
+}
+
+void BenchFlushCaches(void) {
+  static unsigned char *junk = NULL;
+  static long junkBytes = 0;
+  long i;
+
+  if (junk == NULL) {
+    junkBytes = DEFAULT_LLC;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    if (sysconf(_SC_LEVEL3_CACHE_SIZE) > 0) {
+      junkBytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    }
+#endif
+    junkBytes *= 4;
+    junk = (unsigned char *)calloc(junkBytes, 1);
+    if (junk == NULL) {
+      return;
+    }
+  }
+  // every thread sweeps a share, so the private caches are evicted too
+  unsigned char sink = 0;
+#pragma omp parallel for reduction(^ : sink)
+  for (i = 0; i < junkBytes; i += 64) {
+    junk[i]++;
+    sink ^= junk[i];
+  }
+  BenchSink = sink; // keeps the reads
+}
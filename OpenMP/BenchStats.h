@@ -0,0 +1,29 @@
+#ifndef BENCHSTATS_H
+#define BENCHSTATS_H
+
+/*
+ * Benchmark helpers shared by bench and pi: a monotonic clock, summary
+ * statistics over per-iteration samples and a cache flush for cold runs.
+ */
+struct BenchStats {
+  int n;
+  double min, mean, median, p95, p99, max, stddev;
+};
+
+// monotonic wall-clock time in seconds
+double BenchNow(void);
+
+/**
+ * BenchSummarize - Fills 's' from the n samples, which are sorted in place.
+ * Percentiles use the nearest rank, the standard deviation is the sample one.
+ */
+void BenchSummarize(double *samples, int n, struct BenchStats *s);
+
+/**
+ * BenchFlushCaches - Evicts the caches of every OpenMP thread by writing and
+ * reading a buffer four times the size of the last level cache, so the next
+ * sample starts cold.
+ */
+void BenchFlushCaches(void);
+
+#endif
@@ -1,102 +1,314 @@
 #include "ImageFlip.h"
+#include "Numa.h"
+#include "PixelReverse.h"
 #include <omp.h>
+#include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * The serial flips and the rotations move whole pixels, so their kernels are
+ * stamped out per pixel size from one macro each: PIX, the pixel type, gives
+ * the inner loops a constant stride, and 32-bit pixels move as aligned
+ * uint32_t words (rows are 4-byte multiples in a 64-byte aligned slab), which
+ * the compiler can vectorize. The entry points pick the kernel of ip.Bpp.
+ */
+#define DEFINE_FLIP_VERTICAL(NAME, PIX)                                        \
+  static void NAME(unsigned char **img) {                                      \
+    PIX pix; /* temp swap pixel */                                             \
+    PIX *top, *bottom;                                                         \
+    int row, col;                                                              \
+                                                                               \
+    for (row = 0; row < ip.Vpixels / 2; row++) {                               \
+      top = (PIX *)img[row];                                                   \
+      bottom = (PIX *)img[ip.Vpixels - (row + 1)];                             \
+      for (col = 0; col < ip.Hpixels; col++) {                                 \
+        pix = top[col];                                                        \
+        top[col] = bottom[col];                                                \
+        bottom[col] = pix;                                                     \
+      }                                                                        \
+    }                                                                          \
+  }
+
+DEFINE_FLIP_VERTICAL(FlipVertical8, uint8_t)
+DEFINE_FLIP_VERTICAL(FlipVertical24, struct Pixel)
+DEFINE_FLIP_VERTICAL(FlipVertical32, uint32_t)
 
 void FlipVertical(unsigned char **img) {
-  struct Pixel pix; // temp swap pixel
-  unsigned long col;
-  int row;
+  switch (ip.Bpp) {
+  case 1:
+    FlipVertical8(img);
+    break;
+  case 4:
+    FlipVertical32(img);
+    break;
+  default:
+    FlipVertical24(img);
+    break;
+  }
+}
 
-  // vertical flip
-  for (col = 0; col < ip.Hbytes; col += 3) {
-    row = 0;
-    while (row < ip.Vpixels / 2) {
-      pix.B = img[row][col];
-      pix.G = img[row][col + 1];
-      pix.R = img[row][col + 2];
+void FlipHorizontal(unsigned char **img) {
+  int row;
 
-      img[row][col] = img[ip.Vpixels - (row + 1)][col];
-      img[row][col + 1] = img[ip.Vpixels - (row + 1)][col + 1];
-      img[row][col + 2] = img[ip.Vpixels - (row + 1)][col + 2];
+  // horizontal flip, one row at a time with the SIMD pixel reversal kernel
+  for (row = 0; row < ip.Vpixels; row++) {
+    ReverseRowBpp(img[row], ip.Hpixels, ip.Bpp);
+  }
+}
 
-      img[ip.Vpixels - (row + 1)][col] = pix.B;
-      img[ip.Vpixels - (row + 1)][col + 1] = pix.G;
-      img[ip.Vpixels - (row + 1)][col + 2] = pix.R;
+/*
+ * Vertical swap engine. Row pairs are swapped in place, one SWAP_CHUNK-byte
+ * chunk at a time: the top chunk is staged in an L1-resident buffer, the
+ * bottom chunk is copied up and the staged one copied down, so every image
+ * byte is read from and written to memory once. A work unit is one chunk of
+ * one row pair; every thread gets a contiguous range of units, so it walks
+ * its top rows forward, its bottom rows backward and every row front to back.
+ * Rows of any width are handled. When the image does not fit in the last level
+ * cache the copies into the image use non-temporal (streaming) stores, since
+ * the rows will not be reused before they are evicted.
+ *
+ * In NUMA mode (-n) FirstTouchImage() faults every chunk in from the thread
+ * this split will give it to, and the horizontal flip splits its row pairs
+ * the same way, so each thread works on memory of its own node.
+ */
+#define SWAP_CHUNK 4096       // bytes of a row swapped per work unit
+#define DEFAULT_LLC (8 << 20) // when the LLC size cannot be queried
 
-      row++;
+static long LastLevelCacheBytes() {
+  static long llc = 0;
+  if (llc == 0) {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    if (llc <= 0) {
+      llc = DEFAULT_LLC;
     }
   }
+  return llc;
 }
 
-void FlipHorizontal(unsigned char **img) {
-  struct Pixel pix; // temp swap pixel
-  int row, col;
+// memcpy() whose stores bypass the cache
+static void StreamCopy(unsigned char *dst, const unsigned char *src,
+                       size_t n) {
+#ifdef __SSE2__
+  size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+  if (head > n) {
+    head = n;
+  }
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  n -= head;
+  for (; n >= 64; n -= 64, dst += 64, src += 64) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)(src));
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i *)(src + 32));
+    __m128i v3 = _mm_loadu_si128((const __m128i *)(src + 48));
+    _mm_stream_si128((__m128i *)(dst), v0);
+    _mm_stream_si128((__m128i *)(dst + 16), v1);
+    _mm_stream_si128((__m128i *)(dst + 32), v2);
+    _mm_stream_si128((__m128i *)(dst + 48), v3);
+  }
+#endif
+  memcpy(dst, src, n);
+}
 
-  // horizontal flip
-  for (row = 0; row < ip.Vpixels; row++) {
-    col = 0;
-    while (col < (ip.Hpixels * 3) / 2) {
-      pix.B = img[row][col];
-      pix.G = img[row][col + 1];
-      pix.R = img[row][col + 2];
+// Work units [*first, *last) of the calling thread: a contiguous share, so
+// its top rows and their mirrored bottom rows form two bands of the image
+static void ThreadUnits(long units, long *first, long *last) {
+  int nth = omp_get_num_threads();
+  int tid = omp_get_thread_num();
+  *first = units * tid / nth;
+  *last = units * (tid + 1) / nth;
+}
 
-      img[row][col] = img[row][ip.Hpixels * 3 - (col + 3)];
-      img[row][col + 1] = img[row][ip.Hpixels * 3 - (col + 2)];
-      img[row][col + 2] = img[row][ip.Hpixels * 3 - (col + 1)];
+/**
+ * FirstTouchImage - Writes every swap unit of a freshly allocated rows x
+ * rowBytes image from the thread FlipVerticalMultiThreaded() hands it to,
+ * so the kernel places its pages on that thread's node. The middle row of an
+ * odd height is left to whoever touches it first.
+ */
+void FirstTouchImage(unsigned char **img, int rows, unsigned long rowBytes) {
+  long chunksPerRow = (rowBytes + SWAP_CHUNK - 1) / SWAP_CHUNK;
+  long units = (long)(rows / 2) * chunksPerRow;
 
-      img[row][ip.Hpixels * 3 - (col + 3)] = pix.B;
-      img[row][ip.Hpixels * 3 - (col + 2)] = pix.G;
-      img[row][ip.Hpixels * 3 - (col + 1)] = pix.R;
+#pragma omp parallel shared(img)
+  {
+    long first, last, u, row, off, len;
 
-      col += 3;
+    ThreadUnits(units, &first, &last);
+    for (u = first; u < last; u++) {
+      row = u / chunksPerRow;
+      off = (u % chunksPerRow) * SWAP_CHUNK;
+      len = ((long)rowBytes - off < SWAP_CHUNK) ? (long)rowBytes - off
+                                                 : SWAP_CHUNK;
+      memset(img[row] + off, 0, len);
+      memset(img[rows - (row + 1)] + off, 0, len);
     }
   }
 }
 
 void FlipVerticalMultiThreaded(unsigned char **img) {
-  int row, row2;
-
-  unsigned char Buffer[16384];  // This is the buffer to get the first row
-  unsigned char Buffer2[16384]; // This is the buffer to get the second row
-
-// vertical flip
-#pragma omp parallel for private(row, row2, Buffer, Buffer2) shared(img)
-  for (row = 0; row < ip.Vpixels / 2; row++) {
-    memcpy((void *)Buffer, (void *)img[row], (size_t)ip.Hbytes);
-    row2 = ip.Vpixels - (row + 1);
-    memcpy((void *)Buffer2, (void *)img[row2], (size_t)ip.Hbytes);
-    // swap row with row2
-    memcpy((void *)img[row], (void *)Buffer2, (size_t)ip.Hbytes);
-    memcpy((void *)img[row2], (void *)Buffer, (size_t)ip.Hbytes);
+  long chunksPerRow = (ip.Hbytes + SWAP_CHUNK - 1) / SWAP_CHUNK;
+  long units = (long)(ip.Vpixels / 2) * chunksPerRow;
+  int stream = (double)ip.Hbytes * ip.Vpixels > (double)LastLevelCacheBytes();
+
+#pragma omp parallel shared(img)
+  {
+    unsigned char Buffer[SWAP_CHUNK] __attribute__((aligned(64)));
+    double start = NumaNodes ? omp_get_wtime() : 0.0;
+    long first, last, u, row, off, len, moved = 0;
+    unsigned char *top, *bottom;
+
+    ThreadUnits(units, &first, &last);
+
+    for (u = first; u < last; u++) {
+      row = u / chunksPerRow;
+      off = (u % chunksPerRow) * SWAP_CHUNK;
+      len = ((long)ip.Hbytes - off < SWAP_CHUNK) ? (long)ip.Hbytes - off
+                                                   : SWAP_CHUNK;
+      top = img[row] + off;
+      bottom = img[ip.Vpixels - (row + 1)] + off;
+
+      memcpy(Buffer, top, len);
+      if (stream) {
+        StreamCopy(top, bottom, len);
+        StreamCopy(bottom, Buffer, len);
+      } else {
+        memcpy(top, bottom, len);
+        memcpy(bottom, Buffer, len);
+      }
+      moved += 2 * len;
+    }
+#ifdef __SSE2__
+    if (stream) {
+      _mm_sfence(); // make the streamed rows visible before the barrier
+    }
+#endif
+    if (NumaNodes) {
+      NumaAddWork(omp_get_thread_num(), omp_get_wtime() - start,
+                  2.0 * moved);
+    }
   }
 }
 
 void FlipHorizontalMultiThreaded(unsigned char **img) {
-  struct Pixel pix; // temp swap pixel
-  int row, col;
+  // rows are reversed in place, so there is no row buffer to overrun. The
+  // rows go out in mirrored pairs, split like the vertical flip's, and the
+  // middle row of an odd height pairs with itself
+  long pairs = (ip.Vpixels + 1) / 2;
 
-  unsigned char
-      Buffer[16384]; // This is the buffer to use to get the entire row
+#pragma omp parallel shared(img)
+  {
+    double start = NumaNodes ? omp_get_wtime() : 0.0;
+    long first, last, row, mirror, moved = 0;
 
-#pragma omp parallel for private(row, col, pix, Buffer) shared(img)
-  for (row = 0; row < ip.Vpixels; row++) {
-    memcpy((void *)Buffer, (void *)img[row], (size_t)ip.Hbytes);
-    col = 0;
-    while (col < ip.Hpixels * 3 / 2) {
-      pix.B = Buffer[col];
-      pix.G = Buffer[col + 1];
-      pix.R = Buffer[col + 2];
-
-      Buffer[col] = Buffer[ip.Hpixels * 3 - (col + 3)];
-      Buffer[col + 1] = Buffer[ip.Hpixels * 3 - (col + 2)];
-      Buffer[col + 2] = Buffer[ip.Hpixels * 3 - (col + 1)];
-
-      Buffer[ip.Hpixels * 3 - (col + 3)] = pix.B;
-      Buffer[ip.Hpixels * 3 - (col + 2)] = pix.G;
-      Buffer[ip.Hpixels * 3 - (col + 1)] = pix.R;
-
-      col += 3;
+    ThreadUnits(pairs, &first, &last);
+    for (row = first; row < last; row++) {
+      mirror = ip.Vpixels - (row + 1);
+      ReverseRowBpp(img[row], ip.Hpixels, ip.Bpp);
+      moved += ip.Hbytes;
+      if (mirror != row) {
+        ReverseRowBpp(img[mirror], ip.Hpixels, ip.Bpp);
+        moved += ip.Hbytes;
+      }
+    }
+    if (NumaNodes) {
+      NumaAddWork(omp_get_thread_num(), omp_get_wtime() - start,
+                  2.0 * moved);
     }
-    memcpy((void *)img[row], (void *)Buffer, (size_t)ip.Hbytes);
   }
 }
+
+/*
+ * Rotation engine. Rotations and the transpose change the image dimensions,
+ * so they work out of place: 'src' is an ip.Hpixels x ip.Vpixels image and
+ * 'dst' must have ip.Hpixels rows of BMPRowBytes(ip.Vpixels, ip.Bpp) bytes.
+ * Callers update ip with SetImageSize() afterwards.
+ *
+ * Rows are stored bottom-up, so in storage coordinates each operation maps
+ * destination pixel (row y, column x) to source pixel (row x or V-1-x,
+ * column y or W-1-y). The destination is walked in ROT_TILE x ROT_TILE pixel
+ * tiles: a tile reads ROT_TILE source rows and writes ROT_TILE destination
+ * rows, all of which stay in L1 and in the TLB while the tile is copied, where
+ * a row-by-column loop would touch a new page for nearly every pixel. Tiles
+ * are spread over the OpenMP threads, neighbouring tiles of a destination row
+ * going to the same thread. Like the serial flips, the tile copy is stamped
+ * out per pixel type.
+ */
+#define ROT_TILE 32 // pixels
+
+#define DEFINE_ROTATE_TILES(NAME, PIX)                                         \
+  static void NAME(unsigned char **dst, unsigned char **src, int mirrorRow,    \
+                   int mirrorCol) {                                            \
+    int W = ip.Hpixels, V = ip.Vpixels;                                        \
+    unsigned long dstPixBytes = (unsigned long)V * sizeof(PIX);                \
+    unsigned long dstHbytes = (dstPixBytes + 3) & (~3);                        \
+    long tilesX = (V + ROT_TILE - 1) / ROT_TILE;                               \
+    long tilesY = (W + ROT_TILE - 1) / ROT_TILE;                               \
+    long t;                                                                    \
+                                                                               \
+    _Pragma("omp parallel for schedule(static) shared(dst, src)")              \
+    for (t = 0; t < tilesX * tilesY; t++) {                                    \
+      const PIX *srcRow[ROT_TILE];                                             \
+      int x0 = (t % tilesX) * ROT_TILE, y0 = (t / tilesX) * ROT_TILE;          \
+      int x1 = (x0 + ROT_TILE < V) ? x0 + ROT_TILE : V;                        \
+      int y1 = (y0 + ROT_TILE < W) ? y0 + ROT_TILE : W;                        \
+      int x, y, sx;                                                            \
+      PIX *d;                                                                  \
+                                                                               \
+      /* destination column x reads source row x (or its mirror) */           \
+      for (x = x0; x < x1; x++) {                                              \
+        srcRow[x - x0] = (const PIX *)src[mirrorRow ? V - (x + 1) : x];        \
+      }                                                                        \
+      for (y = y0; y < y1; y++) {                                              \
+        sx = mirrorCol ? W - (y + 1) : y;                                      \
+        d = (PIX *)dst[y];                                                     \
+        for (x = x0; x < x1; x++) {                                            \
+          d[x] = srcRow[x - x0][sx];                                           \
+        }                                                                      \
+        if (x1 == V) {                                                         \
+          memset(dst[y] + dstPixBytes, 0, dstHbytes - dstPixBytes);            \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }
+
+DEFINE_ROTATE_TILES(RotateTiles8, uint8_t)
+DEFINE_ROTATE_TILES(RotateTiles24, struct Pixel)
+DEFINE_ROTATE_TILES(RotateTiles32, uint32_t)
+
+static void RotateTiles(unsigned char **dst, unsigned char **src,
+                        int mirrorRow, int mirrorCol) {
+  switch (ip.Bpp) {
+  case 1:
+    RotateTiles8(dst, src, mirrorRow, mirrorCol);
+    break;
+  case 4:
+    RotateTiles32(dst, src, mirrorRow, mirrorCol);
+    break;
+  default:
+    RotateTiles24(dst, src, mirrorRow, mirrorCol);
+    break;
+  }
+}
+
+// 90 degrees clockwise, as the image is displayed
+void Rotate90(unsigned char **dst, unsigned char **src) {
+  RotateTiles(dst, src, 0, 1);
+}
+
+// 270 degrees clockwise (90 counter-clockwise), as the image is displayed
+void Rotate270(unsigned char **dst, unsigned char **src) {
+  RotateTiles(dst, src, 1, 0);
+}
+
+// transpose about the displayed main diagonal (top-left to bottom-right)
+void Transpose(unsigned char **dst, unsigned char **src) {
+  RotateTiles(dst, src, 1, 1);
+}
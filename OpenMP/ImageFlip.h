@@ -4,4 +4,12 @@ void FlipVertical(unsigned char **img);
 void FlipHorizontal(unsigned char **img);
 
 void FlipVerticalMultiThreaded(unsigned char **img);
-void FlipHorizontalMultiThreaded(unsigned char **img);
\ No newline at end of file
+void FlipHorizontalMultiThreaded(unsigned char **img);
+
+// NUMA mode: place a new image's pages where the multi-threaded flips use them
+void FirstTouchImage(unsigned char **img, int rows, unsigned long rowBytes);
+
+// out of place, 'dst' holds ip.Hpixels rows of the rotated width
+void Rotate90(unsigned char **dst, unsigned char **src);
+void Rotate270(unsigned char **dst, unsigned char **src);
+void Transpose(unsigned char **dst, unsigned char **src);
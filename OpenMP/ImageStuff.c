@@ -1,77 +1,686 @@
+#define _GNU_SOURCE // O_DIRECT
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
+#include <unistd.h>
 
 
-#include "ImageStuff.h"
+#include "ImageFlip.h" // includes ImageStuff.h
+#include "Numa.h"
+#include "PixelReverse.h"
+#include "Uring.h"
 
-unsigned char **ReadBMP(char *filename) {
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#define SLAB_ALIGN 64              // cache line
+#define HUGEPAGE_SIZE (2UL << 20)  // x86-64 transparent huge page
+
+int UseHugePages = 0;
+int BMPBackend = BMP_IO_WRITEV;
+
+/**
+ * AllocImage - Allocates an image as one contiguous, 64-byte aligned slab of
+ * rows*rowBytes bytes plus an array of row pointers into it, so img[row]
+ * keeps working for the flip functions. When UseHugePages is set the slab is
+ * 2 MB aligned and madvise()d for transparent huge pages. In NUMA mode the
+ * slab is first touched by the threads that will flip it.
+ *
+ * The row pointer array is a view: it must not be reordered, since
+ * FreeImage() finds the slab through img[0].
+ */
+unsigned char **AllocImage(int rows, unsigned long rowBytes) {
+  size_t slabBytes = (size_t)rows * rowBytes;
+  size_t align = SLAB_ALIGN;
+  unsigned char *slab;
   int i;
-  FILE *f = fopen(filename, "rb");
-  if (f == NULL) {
-    printf("\n\n%s NOT FOUND\n\n", filename);
+
+  if (UseHugePages) {
+    align = HUGEPAGE_SIZE;
+    slabBytes = (slabBytes + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+  }
+  if (posix_memalign((void **)&slab, align, slabBytes ? slabBytes : align)) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  if (UseHugePages) {
+    madvise(slab, slabBytes, MADV_HUGEPAGE); // advisory, ignore failures
+  }
+#endif
+
+  unsigned char **img =
+      (unsigned char **)malloc((rows ? rows : 1) * sizeof(unsigned char *));
+  if (img == NULL) {
+    free(slab);
+    return NULL;
+  }
+  img[0] = slab;
+  for (i = 1; i < rows; i++) {
+    img[i] = slab + (size_t)i * rowBytes;
+  }
+  if (NumaNodes) {
+    FirstTouchImage(img, rows, rowBytes);
+  }
+  return img;
+}
+
+void FreeImage(unsigned char **img) {
+  if (img == NULL) {
+    return;
+  }
+  free(img[0]);
+  free(img);
+}
+
+const char *BMPBackendName(int backend) {
+  switch (backend) {
+  case BMP_IO_STDIO:
+    return "stdio";
+  case BMP_IO_WRITEV:
+    return "writev";
+  case BMP_IO_MMAP:
+    return "mmap";
+  case BMP_IO_URING:
+    return "uring";
+  case BMP_IO_URING_DIRECT:
+    return "uring-direct";
+  default:
+    return "unknown";
+  }
+}
+
+/**
+ * ParseBMPBackend - Maps a backend name ("stdio", "writev", "mmap", "uring"
+ * or "uring-direct") to its BMP_IO_* value.
+ *
+ * @return: the backend, or -1 if the name is unknown.
+ */
+int ParseBMPBackend(const char *name) {
+  int b;
+  for (b = BMP_IO_STDIO; b <= BMP_IO_URING_DIRECT; b++) {
+    if (strcmp(name, BMPBackendName(b)) == 0) {
+      return b;
+    }
+  }
+  return -1;
+}
+
+// Copies a whole file region into 'dst' through the page cache mapping, one
+// row per iteration, spread over the OpenMP threads. A short file only maps
+// and copies the bytes it has, keeping the rest like the fread() path does.
+static void MapAndCopyRows(int fd, unsigned char *dst, int rows,
+                           unsigned long rowBytes, unsigned int headerBytes,
+                           char *filename) {
+  size_t mapBytes = headerBytes + (size_t)rows * rowBytes;
+  size_t pixelBytes;
+  unsigned char *map;
+  struct stat st;
+  int i;
+
+  if (fstat(fd, &st) != 0) {
+    printf("\n\nCannot stat %s\n\n", filename);
     exit(1);
   }
+  if ((size_t)st.st_size <= headerBytes) {
+    return;
+  }
+  if ((size_t)st.st_size < mapBytes) {
+    mapBytes = (size_t)st.st_size;
+  }
+  pixelBytes = mapBytes - headerBytes;
+  map = (unsigned char *)mmap(NULL, mapBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    printf("\n\nCannot mmap %s\n\n", filename);
+    exit(1);
+  }
+  madvise(map, mapBytes, MADV_SEQUENTIAL);
+#pragma omp parallel for private(i)
+  for (i = 0; i < rows; i++) {
+    size_t start = (size_t)i * rowBytes;
+    if (start < pixelBytes) {
+      memcpy(dst + start, map + headerBytes + start,
+             pixelBytes - start < rowBytes ? pixelBytes - start : rowBytes);
+    }
+  }
+  munmap(map, mapBytes);
+}
 
-  unsigned char HeaderInfo[54];
-  fread(HeaderInfo, sizeof(unsigned char), 54, f); // read the 54-byte header
+/*
+ * io_uring backends. UringTransfer() moves the whole file, header included, in
+ * strips that start at offset 0, so they stay aligned for O_DIRECT; these
+ * callbacks copy the pixels between the strips and the rows. When io_uring
+ * cannot be set up (old kernel, seccomp, io_uring_disabled) the backends fall
+ * back to the synchronous pread/writev path. When the file system refuses
+ * O_DIRECT, uring-direct goes through the page cache.
+ */
+struct UringRows {
+  const struct ImgProp *p;
+  unsigned char **rows;   // written rows[0..Vpixels-1]
+  unsigned char *slab;    // read pixels
+  int hflip;
+  unsigned char *rowBuf;  // a reversed row that straddles two strips
+};
 
-  // extract image height and width from header
-  int width = *(int *)&HeaderInfo[18];
-  int height = *(int *)&HeaderInfo[22];
+// Copies the pixels of a strip that was read into the slab
+static void UringDrainSlab(unsigned char *buf, size_t fileOff, size_t len,
+                           void *arg) {
+  struct UringRows *u = (struct UringRows *)arg;
+  size_t header = u->p->HeaderBytes;
+  size_t skip = fileOff < header ? header - fileOff : 0;
 
-  // copy header for re-use
-  for (i = 0; i < 54; i++) {
-    ip.HeaderInfo[i] = HeaderInfo[i];
+  if (skip < len) {
+    memcpy(u->slab + fileOff + skip - header, buf + skip, len - skip);
   }
+}
 
-  ip.Vpixels = height;
+// Writes a reversed copy of 'src' (pixels and padding) into 'dst'
+static void ReverseCopyFullRow(const struct ImgProp *p, unsigned char *dst,
+                               unsigned char *src) {
+  unsigned long pixBytes = (unsigned long)p->Hpixels * p->Bpp;
+  ReverseCopyRowBpp(dst, src, p->Hpixels, p->Bpp);
+  memcpy(dst + pixBytes, src + pixBytes, p->Hbytes - pixBytes);
+}
+
+// Fills a strip to be written with the header and the rows it covers
+static void UringFillRows(unsigned char *buf, size_t fileOff, size_t len,
+                          void *arg) {
+  struct UringRows *u = (struct UringRows *)arg;
+  const struct ImgProp *p = u->p;
+  size_t pos = fileOff, end = fileOff + len, col, n;
+  unsigned char *src;
+
+  for (; pos < end && pos < p->HeaderBytes; pos++) {
+    *buf++ = p->HeaderInfo[pos];
+  }
+  while (pos < end) {
+    src = u->rows[(pos - p->HeaderBytes) / p->Hbytes];
+    col = (pos - p->HeaderBytes) % p->Hbytes;
+    n = p->Hbytes - col < end - pos ? p->Hbytes - col : end - pos;
+    if (u->hflip && n == p->Hbytes) {
+      ReverseCopyFullRow(p, buf, src);
+    } else {
+      if (u->hflip) {
+        ReverseCopyFullRow(p, u->rowBuf, src);
+        src = u->rowBuf;
+      }
+      memcpy(buf, src + col, n);
+    }
+    buf += n;
+    pos += n;
+  }
+}
+
+static void UringUnavailable() {
+  static int warned = 0;
+  if (!warned) {
+    warned = 1;
+    printf("\nio_uring unavailable (%s), using the writev backend\n",
+           strerror(errno));
+  }
+}
+
+// Opens 'filename' with O_DIRECT for uring-direct, unless it is refused
+static int OpenUring(char *filename, int flags, int *direct) {
+  int fd;
+
+  *direct = BMPBackend == BMP_IO_URING_DIRECT;
+  if (*direct) {
+    fd = open(filename, flags | O_DIRECT, 0644);
+    if (fd >= 0) {
+      return fd;
+    }
+    *direct = 0;
+  }
+  return open(filename, flags, 0644);
+}
+
+// @return: 0, or -1 if io_uring is unavailable and nothing was read
+static int ReadBMPUring(char *filename, const struct ImgProp *props,
+                        unsigned char *slab, size_t imageBytes) {
+  struct UringRows u;
+  int direct, err, fd = OpenUring(filename, O_RDONLY, &direct);
+
+  if (fd < 0) {
+    printf("\n\n%s NOT FOUND\n\n", filename);
+    exit(1);
+  }
+  memset(&u, 0, sizeof(u));
+  u.p = props;
+  u.slab = slab;
+  err = UringTransfer(fd, 0, direct, props->HeaderBytes + imageBytes,
+                      UringDrainSlab, &u);
+  close(fd);
+  if (err > 0) {
+    printf("\n\nFILE READ ERROR: %s (%s)\n\n", filename, strerror(err));
+    exit(1);
+  }
+  if (err < 0) {
+    UringUnavailable();
+  }
+  return err;
+}
+
+// @return: 0, or -1 if io_uring is unavailable and nothing was written
+static int WriteBMPRowsUring(const struct ImgProp *p, unsigned char **rows,
+                             int hflip, char *filename) {
+  struct UringRows u;
+  int direct, err;
+  int fd = OpenUring(filename, O_WRONLY | O_CREAT | O_TRUNC, &direct);
+
+  if (fd < 0) {
+    printf("\n\nFILE CREATION ERROR: %s\n\n", filename);
+    exit(1);
+  }
+  u.p = p;
+  u.rows = rows;
+  u.slab = NULL;
+  u.hflip = hflip;
+  u.rowBuf = hflip ? (unsigned char *)malloc(p->Hbytes) : NULL;
+  if (hflip && u.rowBuf == NULL) {
+    printf("\n\nCannot allocate the output row buffer\n\n");
+    exit(1);
+  }
+  err = UringTransfer(fd, 1, direct,
+                      p->HeaderBytes + (size_t)p->Vpixels * p->Hbytes,
+                      UringFillRows, &u);
+  free(u.rowBuf);
+  close(fd);
+  if (err > 0) {
+    printf("\n\nFILE WRITE ERROR: %s (%s)\n\n", filename, strerror(err));
+    exit(1);
+  }
+  if (err < 0) {
+    UringUnavailable();
+  }
+  return err;
+}
+
+// Bytes of a row of 'width' pixels of 'bpp' bytes, padded to 4 bytes
+unsigned long BMPRowBytes(int width, int bpp) {
+  return ((unsigned long)width * bpp + 3) & (~3UL);
+}
+
+/**
+ * SetImageSize - Makes ip describe a width x height image: recomputes the
+ * padded row size and rewrites the dimensions, the image size and the file
+ * size in the header, e.g. after a rotation swapped width and height.
+ */
+void SetImageSize(int width, int height) {
   ip.Hpixels = width;
-  int RowBytes = (width * 3 + 3) & (~3);
-  ip.Hbytes = RowBytes;
+  ip.Vpixels = height;
+  ip.Hbytes = BMPRowBytes(width, ip.Bpp);
+  *(int *)&ip.HeaderInfo[18] = width;
+  *(int *)&ip.HeaderInfo[22] = height;
+  *(unsigned int *)&ip.HeaderInfo[34] = ip.Hbytes * height;
+  *(unsigned int *)&ip.HeaderInfo[2] = ip.HeaderBytes + ip.Hbytes * height;
+}
 
-  printf("\n   Input BMP File name: %20s  (%u x %u)\n", filename, ip.Hpixels,
-         ip.Vpixels);
+/**
+ * ReadBMPHeader - Reads everything before the pixels of the BMP open on 'fd'
+ * into props->HeaderInfo: the file and info headers and, for 8-bit images,
+ * the palette. Sets the dimensions, the bytes per pixel from biBitCount and
+ * the row size. Only uncompressed 8, 24 or 32-bit pixels are taken; the bit
+ * fields of 32-bit images only name the channels, so those are accepted too.
+ *
+ * @return: 0, or -1 after saying why the file cannot be read.
+ */
+int ReadBMPHeader(int fd, char *filename, struct ImgProp *props) {
+  unsigned char *h = props->HeaderInfo;
+  unsigned int offset, compression;
+  int bits;
 
-  unsigned char **TheImage =
-      (unsigned char **)malloc(height * sizeof(unsigned char *));
-  for (i = 0; i < height; i++) {
-    TheImage[i] = (unsigned char *)malloc(RowBytes * sizeof(unsigned char));
+  if (pread(fd, h, 54, 0) != 54 || h[0] != 'B' || h[1] != 'M') {
+    printf("\n\n%s is not a BMP file\n\n", filename);
+    return -1;
+  }
+  offset = *(unsigned int *)&h[10];
+  bits = *(unsigned short *)&h[28];
+  compression = *(unsigned int *)&h[30];
+  if ((bits != 8 && bits != 24 && bits != 32) ||
+      (compression != 0 &&
+       !(bits == 32 && (compression == 3 || compression == 6))) ||
+      offset < 54 || offset > BMP_MAX_HEADER) {
+    printf("\n\n%s: unsupported BMP (%d bits per pixel, compression %u, "
+           "pixels at byte %u)\n\n",
+           filename, bits, compression, offset);
+    return -1;
   }
+  if (offset > 54 &&
+      pread(fd, h + 54, offset - 54, 54) != (ssize_t)(offset - 54)) {
+    printf("\n\nFILE READ ERROR: %s\n\n", filename);
+    return -1;
+  }
+
+  props->HeaderBytes = offset;
+  props->Bpp = bits / 8;
+  props->Hpixels = *(int *)&h[18];
+  props->Vpixels = *(int *)&h[22];
+  props->Hbytes = BMPRowBytes(props->Hpixels, props->Bpp);
+  return 0;
+}
+
+/**
+ * GenerateImage - Allocates a width x height image of 8, 24 or 32 'bits' per
+ * pixel filled with a deterministic pattern and zeroed row padding, and sets
+ * ip and a complete BMP header for it, so it can be flipped or written with
+ * WriteBMP(). 8-bit images get a grayscale palette. For 24 bits the row
+ * padding is (4 - width * 3 % 4) % 4 bytes, as the format requires, so widths
+ * of 4k .. 4k+3 pixels cover the four padding cases.
+ *
+ * @return: the image, or NULL if it cannot be allocated.
+ */
+unsigned char **GenerateImage(int width, int height, int bits) {
+  int bpp = bits / 8;
+  unsigned long pixBytes = (unsigned long)width * bpp;
+  unsigned char **img, *px;
+  int x, y, i;
 
-  for (i = 0; i < height; i++) {
-    fread(TheImage[i], sizeof(unsigned char), RowBytes, f);
+  ip.Bpp = bpp;
+  ip.HeaderBytes = 54 + (bpp == 1 ? 256 * 4 : 0);
+  memset(ip.HeaderInfo, 0, ip.HeaderBytes);
+  ip.HeaderInfo[0] = 'B';
+  ip.HeaderInfo[1] = 'M';
+  *(unsigned int *)&ip.HeaderInfo[10] = ip.HeaderBytes; // pixel data offset
+  *(unsigned int *)&ip.HeaderInfo[14] = 40; // BITMAPINFOHEADER
+  *(unsigned short *)&ip.HeaderInfo[26] = 1;    // planes
+  *(unsigned short *)&ip.HeaderInfo[28] = bits; // bits per pixel
+  *(int *)&ip.HeaderInfo[38] = 2835;            // 72 DPI
+  *(int *)&ip.HeaderInfo[42] = 2835;
+  if (bpp == 1) {
+    *(unsigned int *)&ip.HeaderInfo[46] = 256; // palette entries
+    for (i = 0; i < 256; i++) {
+      memset(ip.HeaderInfo + 54 + 4 * i, i, 3); // B = G = R, reserved 0
+    }
   }
+  SetImageSize(width, height);
 
-  fclose(f);
-  return TheImage; // remember to free() it in caller!
+  img = AllocImage(height, ip.Hbytes);
+  if (img == NULL) {
+    return NULL;
+  }
+#pragma omp parallel for private(x, px)
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
+      px = img[y] + (size_t)x * bpp;
+      px[0] = (unsigned char)(x * 7 + y * 3);
+      if (bpp >= 3) {
+        px[1] = (unsigned char)(x ^ y);
+        px[2] = (unsigned char)(x * 13 + y * 29);
+      }
+      if (bpp == 4) {
+        px[3] = (unsigned char)(x + y * 5); // alpha
+      }
+    }
+    memset(img[y] + pixBytes, 0, ip.Hbytes - pixBytes);
+  }
+  return img;
 }
 
-void WriteBMP(unsigned char **img, char *filename) {
-  FILE *f = fopen(filename, "wb");
+/**
+ * ReadBMPProps - Reads 'filename' into a new image and describes it in
+ * 'props' instead of ip, so images can be read while another one is flipped
+ * (batch mode). Prints nothing unless the file cannot be read.
+ *
+ * @return: the image, or NULL if the file is missing, not a supported BMP or
+ *          cannot be allocated.
+ */
+unsigned char **ReadBMPProps(char *filename, struct ImgProp *props) {
+  FILE *f = fopen(filename, "rb");
   if (f == NULL) {
+    printf("\n\n%s NOT FOUND\n\n", filename);
+    return NULL;
+  }
+
+  // the header, and the palette of an 8-bit image, are kept for re-use
+  if (ReadBMPHeader(fileno(f), filename, props) != 0) {
+    fclose(f);
+    return NULL;
+  }
+  int height = props->Vpixels;
+  unsigned long RowBytes = props->Hbytes;
+  fseek(f, props->HeaderBytes, SEEK_SET);
+
+  unsigned char **TheImage = AllocImage(height, RowBytes);
+  if (TheImage == NULL) {
+    fclose(f);
+    return NULL;
+  }
+
+  // the slab is contiguous, so the whole image comes in with one read
+  size_t imageBytes = (size_t)height * RowBytes;
+  size_t done = 0;
+  ssize_t got;
+  switch (BMPBackend) {
+  case BMP_IO_STDIO:
+    fread(TheImage[0], sizeof(unsigned char), imageBytes, f);
+    break;
+  case BMP_IO_URING:
+  case BMP_IO_URING_DIRECT:
+    if (ReadBMPUring(filename, props, TheImage[0], imageBytes) == 0) {
+      break;
+    }
+    // fall through
+  case BMP_IO_WRITEV:
+    while (done < imageBytes) {
+      got = pread(fileno(f), TheImage[0] + done, imageBytes - done,
+                  props->HeaderBytes + done);
+      if (got <= 0) {
+        break; // short file, keep what was read like fread() does
+      }
+      done += got;
+    }
+    break;
+  case BMP_IO_MMAP:
+    MapAndCopyRows(fileno(f), TheImage[0], height, RowBytes,
+                   props->HeaderBytes, filename);
+    break;
+  }
+
+  fclose(f);
+  return TheImage; // remember to FreeImage() it in caller!
+}
+
+unsigned char **ReadBMP(char *filename) {
+  unsigned char **TheImage = ReadBMPProps(filename, &ip);
+
+  if (TheImage == NULL) {
+    return NULL;
+  }
+  printf("\n   Input BMP File name: %20s  (%u x %u, %d-bit)\n", filename,
+         ip.Hpixels, ip.Vpixels, 8 * ip.Bpp);
+  return TheImage;
+}
+
+// writev() every iovec completely, resuming after partial writes
+static void WriteAllV(int fd, struct iovec *iov, int cnt, char *filename) {
+  ssize_t put;
+
+  while (cnt > 0) {
+    put = writev(fd, iov, cnt > IOV_MAX ? IOV_MAX : cnt);
+    if (put < 0) {
+      printf("\n\nFILE WRITE ERROR: %s\n\n", filename);
+      exit(1);
+    }
+    while (cnt > 0 && (size_t)put >= iov->iov_len) {
+      put -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + put;
+      iov->iov_len -= put;
+    }
+  }
+}
+
+/*
+ * Bulk writers. The writev backend hands the header and up to IOV_MAX rows to
+ * the kernel per system call, straight from the row pointers; horizontally
+ * flipped rows are first reversed into a staging buffer of about STAGE_BYTES.
+ * The mmap backend sizes the file with ftruncate(), maps it and lets the
+ * OpenMP threads copy the rows into the mapping in parallel.
+ */
+#define STAGE_BYTES (1 << 20)
+
+static void WriteBMPRowsVec(const struct ImgProp *p, unsigned char **rows,
+                            int hflip, char *filename) {
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("\n\nFILE CREATION ERROR: %s\n\n", filename);
+    exit(1);
+  }
+
+  int batch = IOV_MAX - 1, x, k, n;
+  unsigned char *stage = NULL;
+  struct iovec *iov =
+      (struct iovec *)malloc((batch + 1) * sizeof(struct iovec));
+
+  if (hflip) {
+    batch = STAGE_BYTES / p->Hbytes;
+    if (batch < 1) {
+      batch = 1;
+    } else if (batch > IOV_MAX - 1) {
+      batch = IOV_MAX - 1;
+    }
+    stage = (unsigned char *)malloc((size_t)batch * p->Hbytes);
+  }
+  if (iov == NULL || (hflip && stage == NULL)) {
+    printf("\n\nCannot allocate the output buffers\n\n");
+    exit(1);
+  }
+
+  // the header goes out with the first batch of rows
+  iov[0].iov_base = (void *)p->HeaderInfo;
+  iov[0].iov_len = p->HeaderBytes;
+  n = 1;
+  for (x = 0; x < p->Vpixels; x += batch) {
+    for (k = 0; k < batch && x + k < p->Vpixels; k++, n++) {
+      if (hflip) {
+        ReverseCopyFullRow(p, stage + (size_t)k * p->Hbytes, rows[x + k]);
+        iov[n].iov_base = stage + (size_t)k * p->Hbytes;
+      } else {
+        iov[n].iov_base = rows[x + k];
+      }
+      iov[n].iov_len = p->Hbytes;
+    }
+    WriteAllV(fd, iov, n, filename);
+    n = 0;
+  }
+  if (n > 0) {
+    WriteAllV(fd, iov, n, filename); // header of an image without rows
+  }
+
+  free(stage);
+  free(iov);
+  close(fd);
+}
+
+static void WriteBMPRowsMap(const struct ImgProp *p, unsigned char **rows,
+                            int hflip, char *filename) {
+  size_t fileBytes = p->HeaderBytes + (size_t)p->Vpixels * p->Hbytes;
+  int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  int x;
+
+  if (fd < 0 || ftruncate(fd, fileBytes) != 0) {
     printf("\n\nFILE CREATION ERROR: %s\n\n", filename);
     exit(1);
   }
+  unsigned char *map = (unsigned char *)mmap(
+      NULL, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    printf("\n\nCannot mmap %s\n\n", filename);
+    exit(1);
+  }
+
+  memcpy(map, p->HeaderInfo, p->HeaderBytes);
+#pragma omp parallel for private(x)
+  for (x = 0; x < p->Vpixels; x++) {
+    unsigned char *dst = map + p->HeaderBytes + (size_t)x * p->Hbytes;
+    if (hflip) {
+      ReverseCopyFullRow(p, dst, rows[x]);
+    } else {
+      memcpy(dst, rows[x], p->Hbytes);
+    }
+  }
 
+  munmap(map, fileBytes);
+  close(fd);
+}
+
+// Writes the image described by p with the current BMPBackend
+static void WriteBMPRowsProps(const struct ImgProp *p, unsigned char **rows,
+                              int hflip, char *filename) {
+  int uring = BMPBackend == BMP_IO_URING || BMPBackend == BMP_IO_URING_DIRECT;
   int x;
-  unsigned long y;
-  char temp;
 
-  // write header
-  for (x = 0; x < 54; x++) {
-    fputc(ip.HeaderInfo[x], f);
+  if (uring && WriteBMPRowsUring(p, rows, hflip, filename) == 0) {
+    return;
   }
+  if (BMPBackend == BMP_IO_WRITEV || uring) {
+    WriteBMPRowsVec(p, rows, hflip, filename);
+  } else if (BMPBackend == BMP_IO_MMAP) {
+    WriteBMPRowsMap(p, rows, hflip, filename);
+  } else {
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+      printf("\n\nFILE CREATION ERROR: %s\n\n", filename);
+      exit(1);
+    }
+    unsigned char *rowBuf = NULL;
+    if (hflip) {
+      rowBuf = (unsigned char *)malloc(p->Hbytes);
+      if (rowBuf == NULL) {
+        printf("\n\nCannot allocate the output row buffer\n\n");
+        exit(1);
+      }
+    }
+
+    // write header
+    fwrite(p->HeaderInfo, sizeof(unsigned char), p->HeaderBytes, f);
 
-  // write data
-  for (x = 0; x < ip.Vpixels; x++) {
-    for (y = 0; y < ip.Hbytes; y++) {
-      temp = img[x][y];
-      fputc(temp, f);
+    // write data
+    for (x = 0; x < p->Vpixels; x++) {
+      if (hflip) {
+        ReverseCopyFullRow(p, rowBuf, rows[x]);
+        fwrite(rowBuf, sizeof(unsigned char), p->Hbytes, f);
+      } else {
+        fwrite(rows[x], sizeof(unsigned char), p->Hbytes, f);
+      }
     }
+    free(rowBuf);
+    fclose(f);
   }
+}
+
+/**
+ * WriteBMPRows - Writes the header and the rows rows[0..Vpixels-1], in that
+ * order, to 'filename' with the current BMPBackend. With 'hflip' set every
+ * row is written with its pixels reversed, so an oriented image can be
+ * written without moving it in memory.
+ */
+void WriteBMPRows(unsigned char **rows, int hflip, char *filename) {
+  WriteBMPRowsProps(&ip, rows, hflip, filename);
   printf("\n  Output BMP File name: %20s  (%u x %u)\n", filename, ip.Hpixels,
          ip.Vpixels);
+}
 
-  fclose(f);
+/**
+ * WriteBMPProps - Writes the image described by 'props' rather than ip,
+ * the batch mode counterpart of ReadBMPProps(). Prints nothing.
+ */
+void WriteBMPProps(unsigned char **img, const struct ImgProp *props,
+                   char *filename) {
+  WriteBMPRowsProps(props, img, 0, filename);
+}
+
+void WriteBMP(unsigned char **img, char *filename) {
+  WriteBMPRows(img, 0, filename);
 }
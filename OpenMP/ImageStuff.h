@@ -1,8 +1,12 @@
+#define BMP_MAX_HEADER 2048 // room for the headers and an 8-bit palette
+
 struct ImgProp {
   int Hpixels;
   int Vpixels;
-  unsigned char HeaderInfo[54];
+  unsigned char HeaderInfo[BMP_MAX_HEADER]; // everything before the pixels
   unsigned long int Hbytes;
+  unsigned int HeaderBytes; // pixel data offset, 54 for a plain 24-bit BMP
+  int Bpp;                  // bytes per pixel: 1, 3 or 4
 };
 
 struct Pixel {
@@ -11,7 +15,32 @@ struct Pixel {
   unsigned char B;
 };
 
+// I/O backends for the BMP readers and writers
+#define BMP_IO_STDIO 0        // fread/fwrite
+#define BMP_IO_WRITEV 1       // pread/writev straight from the rows (default)
+#define BMP_IO_MMAP 2         // mmap of the file, rows copied by OpenMP threads
+#define BMP_IO_URING 3        // io_uring strips through registered buffers
+#define BMP_IO_URING_DIRECT 4 // the same on files opened with O_DIRECT
+
 unsigned char **ReadBMP(char *);
 void WriteBMP(unsigned char **, char *);
+void WriteBMPRows(unsigned char **rows, int hflip, char *filename);
+void SetImageSize(int width, int height);
+unsigned long BMPRowBytes(int width, int bpp);
+int ReadBMPHeader(int fd, char *filename, struct ImgProp *props);
+
+// batch mode: the same, on an explicit ImgProp instead of ip
+unsigned char **ReadBMPProps(char *filename, struct ImgProp *props);
+void WriteBMPProps(unsigned char **img, const struct ImgProp *props,
+                   char *filename);
+unsigned char **GenerateImage(int width, int height, int bits);
+
+unsigned char **AllocImage(int rows, unsigned long rowBytes);
+void FreeImage(unsigned char **);
 
 extern struct ImgProp ip;
+extern int UseHugePages; // back image slabs with transparent huge pages
+extern int BMPBackend;   // one of BMP_IO_*
+
+int ParseBMPBackend(const char *name);
+const char *BMPBackendName(int backend);
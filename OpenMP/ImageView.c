@@ -0,0 +1,135 @@
+#include "ImageView.h"
+#include "ImageFlip.h"
+#include "PixelReverse.h"
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void ViewInit(struct ImgView *v, unsigned char **img) {
+  v->img = img;
+  v->orient = ORIENT_IDENTITY;
+}
+
+/**
+ * ViewApply - Composes one orientation change into the view in O(1).
+ *
+ * @param op: 'V'/'W' vertical flip, 'H'/'I' horizontal flip, 'R' 180 degree
+ *            rotation.
+ * @return: 0 on success, -1 if op is not an orientation change.
+ */
+int ViewApply(struct ImgView *v, char op) {
+  switch (op) {
+  case 'V':
+  case 'W':
+    v->orient ^= ORIENT_FLIP_V;
+    return 0;
+  case 'H':
+  case 'I':
+    v->orient ^= ORIENT_FLIP_H;
+    return 0;
+  case 'R':
+    v->orient ^= ORIENT_ROT180;
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+/**
+ * ViewRow - Returns the stored row that shows up as 'row' in the view. A
+ * vertical flip is just a reversed row stride; a horizontal flip is not
+ * visible here, the row's pixels still have to be read back to front.
+ */
+unsigned char *ViewRow(const struct ImgView *v, int row) {
+  if (v->orient & ORIENT_FLIP_V) {
+    return v->img[ip.Vpixels - (row + 1)];
+  }
+  return v->img[row];
+}
+
+const char *OrientationToString(int orient) {
+  switch (orient) {
+  case ORIENT_IDENTITY:
+    return "Identity";
+  case ORIENT_FLIP_V:
+    return "Vertical flip";
+  case ORIENT_FLIP_H:
+    return "Horizontal flip";
+  case ORIENT_ROT180:
+    return "180 degree rotation";
+  default:
+    return "Unknown";
+  }
+}
+
+/**
+ * MaterializeView - Moves the pixels so the stored image matches the view,
+ * for consumers that need the data in place, then resets the view to the
+ * identity. Every orientation costs at most one pass over the image: the 180
+ * degree case reverses and swaps each row pair while both rows are in cache.
+ */
+void MaterializeView(struct ImgView *v) {
+  unsigned char **img = v->img;
+  int row, row2;
+
+  switch (v->orient) {
+  case ORIENT_FLIP_V:
+    FlipVerticalMultiThreaded(img);
+    break;
+  case ORIENT_FLIP_H:
+    FlipHorizontalMultiThreaded(img);
+    break;
+  case ORIENT_ROT180:
+#pragma omp parallel private(row, row2) shared(img)
+    {
+      unsigned char *tmp = (unsigned char *)malloc(ip.Hbytes);
+      if (tmp == NULL) {
+        printf("\n\nCannot allocate a row buffer\n\n");
+        exit(1);
+      }
+#pragma omp for
+      for (row = 0; row < ip.Vpixels / 2; row++) {
+        row2 = ip.Vpixels - (row + 1);
+        ReverseCopyRowBpp(tmp, img[row], ip.Hpixels, ip.Bpp);
+        ReverseCopyRowBpp(img[row], img[row2], ip.Hpixels, ip.Bpp);
+        memcpy(img[row2], tmp, (size_t)ip.Hpixels * ip.Bpp);
+      }
+      free(tmp);
+    }
+    if (ip.Vpixels % 2) {
+      ReverseRowBpp(img[ip.Vpixels / 2], ip.Hpixels, ip.Bpp);
+    }
+    break;
+  default:
+    break;
+  }
+  v->orient = ORIENT_IDENTITY;
+}
+
+/**
+ * WriteBMPView - Writes the image as the view sees it. This is where the
+ * pixels of a lazy flip chain finally move, fused with the write: rows are
+ * visited in view order and reversed on the way out when needed.
+ */
+void WriteBMPView(const struct ImgView *v, char *filename) {
+  unsigned char **rows = v->img;
+  int row;
+
+  if (v->orient & ORIENT_FLIP_V) {
+    rows = (unsigned char **)malloc(ip.Vpixels * sizeof(unsigned char *));
+    if (rows == NULL) {
+      printf("\n\nCannot allocate the output row view\n\n");
+      exit(1);
+    }
+    for (row = 0; row < ip.Vpixels; row++) {
+      rows[row] = ViewRow(v, row);
+    }
+  }
+
+  WriteBMPRows(rows, (v->orient & ORIENT_FLIP_H) != 0, filename);
+
+  if (rows != v->img) {
+    free(rows);
+  }
+}
@@ -0,0 +1,23 @@
+/*
+ * An image view records how an image is oriented instead of moving its
+ * pixels. Bit 0 of the orientation is a vertical flip and bit 1 a horizontal
+ * flip; the two commute, so any chain of flips collapses to one of the four
+ * states below, and flipping twice the same way is a no-op.
+ */
+#define ORIENT_IDENTITY 0
+#define ORIENT_FLIP_V 1
+#define ORIENT_FLIP_H 2
+#define ORIENT_ROT180 (ORIENT_FLIP_V | ORIENT_FLIP_H)
+
+struct ImgView {
+  unsigned char **img; // the image as stored in memory
+  int orient;          // orientation applied on top of it
+};
+
+void ViewInit(struct ImgView *v, unsigned char **img);
+int ViewApply(struct ImgView *v, char op);
+unsigned char *ViewRow(const struct ImgView *v, int row);
+const char *OrientationToString(int orient);
+
+void MaterializeView(struct ImgView *v);
+void WriteBMPView(const struct ImgView *v, char *filename);
@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+#include "Numa.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int NumaNodes = 0;
+
+static cpu_set_t NodeCpus[NUMA_MAXNODES]; // CPUs of each node with CPUs
+static int NodeCpuCount[NUMA_MAXNODES];
+static int NodeId[NUMA_MAXNODES]; // sysfs node number
+static double ThreadSeconds[NUMA_MAXTHREADS];
+static double ThreadBytes[NUMA_MAXTHREADS];
+
+// Parses a sysfs CPU list such as "0-7,16-23" into 'set'
+static int ParseCpuList(FILE *f, cpu_set_t *set) {
+  int lo, hi, cpu, n = 0;
+  char sep;
+
+  CPU_ZERO(set);
+  while (fscanf(f, "%d", &lo) == 1) {
+    hi = lo;
+    if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+      if (fscanf(f, "%d", &hi) != 1) {
+        break;
+      }
+      fscanf(f, "%c", &sep);
+    }
+    for (cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, set);
+      n++;
+    }
+  }
+  return n;
+}
+
+int NumaInit(void) {
+  char path[64];
+  int node, nodes = 0;
+  FILE *f;
+
+  // node numbers can have holes, and memory-only nodes have no CPUs
+  for (node = 0; node < NUMA_MAXNODES; node++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             node);
+    f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    NodeCpuCount[nodes] = ParseCpuList(f, &NodeCpus[nodes]);
+    NodeId[nodes] = node;
+    if (NodeCpuCount[nodes] > 0) {
+      nodes++;
+    }
+    fclose(f);
+  }
+  NumaNodes = (nodes > 1) ? nodes : 0;
+  return NumaNodes;
+}
+
+int NumaNodeOfThread(int tid, int nthreads) {
+  if (NumaNodes == 0 || nthreads < 1) {
+    return 0;
+  }
+  return (int)((long)tid * NumaNodes / nthreads);
+}
+
+void NumaPinThread(int tid, int nthreads) {
+  int node = NumaNodeOfThread(tid, nthreads);
+  int rank = 0, t, cpu, k;
+  cpu_set_t one;
+
+  if (NumaNodes == 0) {
+    return;
+  }
+  // rank of the thread among the threads of its node
+  for (t = 0; t < tid; t++) {
+    rank += (NumaNodeOfThread(t, nthreads) == node);
+  }
+  k = rank % NodeCpuCount[node];
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &NodeCpus[node]) && k-- == 0) {
+      break;
+    }
+  }
+  CPU_ZERO(&one);
+  CPU_SET(cpu, &one);
+  sched_setaffinity(0, sizeof(one), &one); // advisory, ignore failures
+}
+
+void NumaAddWork(int tid, double seconds, double bytes) {
+  if (tid >= 0 && tid < NUMA_MAXTHREADS) {
+    ThreadSeconds[tid] += seconds;
+    ThreadBytes[tid] += bytes;
+  }
+}
+
+void NumaReport(int nthreads) {
+  int node, t;
+
+  if (NumaNodes == 0) {
+    return;
+  }
+  if (nthreads > NUMA_MAXTHREADS) {
+    nthreads = NUMA_MAXTHREADS;
+  }
+  for (node = 0; node < NumaNodes; node++) {
+    double bytes = 0.0, slowest = 0.0;
+    int threads = 0;
+    for (t = 0; t < nthreads; t++) {
+      if (NumaNodeOfThread(t, nthreads) == node) {
+        bytes += ThreadBytes[t];
+        slowest = (ThreadSeconds[t] > slowest) ? ThreadSeconds[t] : slowest;
+        threads++;
+      }
+    }
+    printf("\nNUMA node %d: %3d threads  %8.2f GB/s", NodeId[node], threads,
+           slowest > 0.0 ? bytes / slowest / 1e9 : 0.0);
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#define NUMA_MAXNODES 64
+#define NUMA_MAXTHREADS 128
+
+/**
+ * NumaNodes - Number of NUMA nodes the threads are spread over, 0 while the
+ * NUMA mode is off. The image allocators and the flips only do their NUMA
+ * work (first touch, per-thread timing) when it is set.
+ */
+extern int NumaNodes;
+
+/**
+ * NumaInit - Finds the nodes that have CPUs in sysfs and turns the NUMA mode
+ * on when there are at least two of them. On a single node machine, or when
+ * sysfs cannot be read, the mode stays off and everything else is a no-op.
+ *
+ * @return: NumaNodes.
+ */
+int NumaInit(void);
+
+/**
+ * NumaNodeOfThread - Node of thread 'tid' out of 'nthreads'. Threads are
+ * given to the nodes in contiguous blocks, matching the contiguous row
+ * bands the flips hand out, so each node owns one band of the image.
+ */
+int NumaNodeOfThread(int tid, int nthreads);
+
+/**
+ * NumaPinThread - Pins the calling thread, thread 'tid' of 'nthreads', to
+ * one CPU of its node, spreading the node's threads over its CPUs. Does
+ * nothing while the NUMA mode is off.
+ */
+void NumaPinThread(int tid, int nthreads);
+
+/**
+ * NumaAddWork - Adds 'seconds' of work moving 'bytes' bytes (read + written)
+ * to thread 'tid', for NumaReport().
+ */
+void NumaAddWork(int tid, double seconds, double bytes);
+
+/**
+ * NumaReport - Prints the bandwidth of every node: the bytes its threads
+ * moved over the time of its slowest thread.
+ */
+void NumaReport(int nthreads);
+
+#endif
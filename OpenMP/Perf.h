@@ -0,0 +1,42 @@
+#ifndef PERF_H
+#define PERF_H
+
+#define PERF_MAXTHREADS 128
+
+/*
+ * Hardware counters around the timed kernels, through perf_event_open().
+ * Every thread that runs a kernel opens its own counters with
+ * PerfOpenThread(); PerfStart()/PerfStop() then enable and read them all from
+ * one thread. Each event is opened on its own, so a kernel or a VM that lacks
+ * one of them only loses that column, and when none can be opened (no PMU,
+ * perf_event_paranoid too high) the report says so and the run goes on.
+ */
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_LLC_MISSES 2
+#define PERF_DTLB_MISSES 3
+#define PERF_BRANCH_MISSES 4
+#define PERF_NEVENTS 5
+
+/**
+ * PerfOpenThread - Opens the counters of the calling thread as thread 'tid'.
+ * They start disabled and count user space only.
+ *
+ * @return: the number of events that could be opened.
+ */
+int PerfOpenThread(int tid);
+
+// enables / disables the counters of every opened thread
+void PerfStart(void);
+void PerfStop(void);
+
+/**
+ * PerfReport - Prints the counts of every thread, then IPC and the misses per
+ * 'unit' (e.g. "pixel" or "step") over 'units' units of work.
+ */
+void PerfReport(double units, const char *unit);
+
+// closes every counter
+void PerfClose(void);
+
+#endif
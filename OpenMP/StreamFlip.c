@@ -0,0 +1,151 @@
+#include <fcntl.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ImageStuff.h"
+#include "PixelReverse.h"
+#include "StreamFlip.h"
+
+#define SWAP_CHUNK 4096 // bytes of a row swapped at a time
+
+// pread()/pwrite() the whole range, resuming after short transfers
+static void ReadFull(int fd, unsigned char *buf, size_t len, off_t off) {
+  ssize_t got;
+  while (len > 0) {
+    got = pread(fd, buf, len, off);
+    if (got <= 0) {
+      printf("\n\nFILE READ ERROR at offset %lld\n\n", (long long)off);
+      exit(1);
+    }
+    buf += got;
+    off += got;
+    len -= got;
+  }
+}
+
+static void WriteFull(int fd, unsigned char *buf, size_t len, off_t off) {
+  ssize_t put;
+  while (len > 0) {
+    put = pwrite(fd, buf, len, off);
+    if (put <= 0) {
+      printf("\n\nFILE WRITE ERROR at offset %lld\n\n", (long long)off);
+      exit(1);
+    }
+    buf += put;
+    off += put;
+    len -= put;
+  }
+}
+
+// Reverses the order of the 'rows' rows held in 'strip'
+static void ReverseStripRows(unsigned char *strip, long rows) {
+  unsigned char Buffer[SWAP_CHUNK];
+  unsigned char *top, *bottom;
+  unsigned long off, len;
+  long row;
+
+  for (row = 0; row < rows / 2; row++) {
+    top = strip + row * ip.Hbytes;
+    bottom = strip + (rows - (row + 1)) * ip.Hbytes;
+    for (off = 0; off < ip.Hbytes; off += len) {
+      len = (ip.Hbytes - off < SWAP_CHUNK) ? ip.Hbytes - off : SWAP_CHUNK;
+      memcpy(Buffer, top + off, len);
+      memcpy(top + off, bottom + off, len);
+      memcpy(bottom + off, Buffer, len);
+    }
+  }
+}
+
+int StreamFlip(char *in, char *out, char flipType, size_t budget) {
+  int fin = open(in, O_RDONLY);
+  if (fin < 0) {
+    printf("\n\n%s NOT FOUND\n\n", in);
+    exit(1);
+  }
+  if (ReadBMPHeader(fin, in, &ip) != 0) {
+    exit(1);
+  }
+
+  printf("\n   Input BMP File name: %20s  (%u x %u, %d-bit)\n", in, ip.Hpixels,
+         ip.Vpixels, 8 * ip.Bpp);
+
+  // split the budget between the threads, fewer threads if it is tight
+  long maxRows = budget / ip.Hbytes;
+  int nthreads = omp_get_max_threads();
+  if (maxRows < 1) {
+    close(fin);
+    return -1;
+  }
+  if (nthreads > maxRows) {
+    nthreads = maxRows;
+  }
+  long stripRows = maxRows / nthreads;
+  if (stripRows > ip.Vpixels) {
+    stripRows = ip.Vpixels > 0 ? ip.Vpixels : 1;
+  }
+  long strips = (ip.Vpixels + stripRows - 1) / stripRows;
+  if (nthreads > strips) {
+    nthreads = strips > 0 ? strips : 1;
+  }
+
+  int fout = open(out, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fout < 0 || ftruncate(fout, ip.HeaderBytes +
+                                       (off_t)ip.Vpixels * ip.Hbytes) != 0) {
+    printf("\n\nFILE CREATION ERROR: %s\n\n", out);
+    exit(1);
+  }
+  WriteFull(fout, ip.HeaderInfo, ip.HeaderBytes, 0);
+
+  printf("\nStreaming with %d threads, %ld-row strips (%.2f MB in flight)\n",
+         nthreads, stripRows,
+         (double)nthreads * stripRows * ip.Hbytes / (1024.0 * 1024.0));
+
+#pragma omp parallel num_threads(nthreads)
+  {
+    unsigned char *strip = (unsigned char *)malloc(stripRows * ip.Hbytes);
+    long s, first, rows, dstRow, r;
+    off_t srcOff;
+
+    if (strip == NULL) {
+      printf("\n\nCannot allocate a strip buffer\n\n");
+      exit(1);
+    }
+
+#pragma omp for schedule(dynamic, 1)
+    for (s = 0; s < strips; s++) {
+      first = s * stripRows;
+      rows = (first + stripRows <= ip.Vpixels) ? stripRows
+                                               : ip.Vpixels - first;
+      srcOff = ip.HeaderBytes + (off_t)first * ip.Hbytes;
+      ReadFull(fin, strip, rows * ip.Hbytes, srcOff);
+      // the input strip will not be read again
+      posix_fadvise(fin, srcOff, rows * ip.Hbytes, POSIX_FADV_DONTNEED);
+
+      if (flipType == 'V' || flipType == 'W') {
+        // rows [first, first+rows) land reversed on the mirrored rows
+        ReverseStripRows(strip, rows);
+        dstRow = ip.Vpixels - (first + rows);
+      } else {
+        for (r = 0; r < rows; r++) {
+          ReverseRowBpp(strip + r * ip.Hbytes, ip.Hpixels, ip.Bpp);
+        }
+        dstRow = first;
+      }
+      WriteFull(fout, strip, rows * ip.Hbytes,
+                ip.HeaderBytes + (off_t)dstRow * ip.Hbytes);
+    }
+    free(strip);
+  }
+
+  close(fin);
+  if (close(fout) != 0) {
+    printf("\n\nFILE WRITE ERROR: %s\n\n", out);
+    exit(1);
+  }
+  printf("\n  Output BMP File name: %20s  (%u x %u)\n", out, ip.Hpixels,
+         ip.Vpixels);
+  return 0;
+}
@@ -0,0 +1,14 @@
+#include <stddef.h>
+
+/**
+ * StreamFlip - Flips the BMP file 'in' into 'out' without ever loading the
+ * whole image. Each OpenMP thread reads a strip of rows with pread(), flips
+ * it and writes it with pwrite() at the mirrored offset, so as many strips
+ * are in flight as there are threads. The strip buffers of all threads
+ * together never exceed 'budget' bytes. Sets ip from the input header.
+ *
+ * @param flipType: 'V'/'W' vertical or 'H'/'I' horizontal.
+ * @param budget: memory budget for pixel data, in bytes.
+ * @return: 0 on success, -1 if the budget cannot hold a single row.
+ */
+int StreamFlip(char *in, char *out, char flipType, size_t budget);
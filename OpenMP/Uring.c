@@ -0,0 +1,249 @@
+#include "Uring.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+long UringRequests = 0, UringEnters = 0;
+
+// The mapped submission and completion rings of one io_uring instance
+struct Ring {
+  int fd;
+  int fixed; // buffers registered, so READ_FIXED / WRITE_FIXED can be used
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  unsigned *cqHead, *cqTail, *cqMask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sqMap, *cqMap;
+  size_t sqMapBytes, cqMapBytes, sqesBytes;
+  unsigned pending; // queued, not yet handed to io_uring_enter()
+  unsigned busy;    // queued and not completed
+  long requests, enters;
+};
+
+// One strip buffer and the file range it holds
+struct Strip {
+  size_t off, len; // file bytes
+  size_t ioLen;    // len, rounded up to URING_ALIGN for O_DIRECT
+  size_t done;     // bytes the kernel has transferred so far
+};
+
+static void RingFree(struct Ring *r) {
+  if (r->sqes != NULL && r->sqes != MAP_FAILED) {
+    munmap(r->sqes, r->sqesBytes);
+  }
+  if (r->cqMap != NULL && r->cqMap != MAP_FAILED && r->cqMap != r->sqMap) {
+    munmap(r->cqMap, r->cqMapBytes);
+  }
+  if (r->sqMap != NULL && r->sqMap != MAP_FAILED) {
+    munmap(r->sqMap, r->sqMapBytes);
+  }
+  close(r->fd);
+}
+
+static int RingInit(struct Ring *r, unsigned char *bufs) {
+  struct io_uring_params p;
+  struct iovec iov[URING_DEPTH];
+  unsigned char *sq, *cq;
+  int i;
+
+  memset(r, 0, sizeof(*r));
+  memset(&p, 0, sizeof(p));
+  r->fd = (int)syscall(__NR_io_uring_setup, URING_DEPTH, &p);
+  if (r->fd < 0) {
+    return -1;
+  }
+
+  r->sqMapBytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cqMapBytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cqMapBytes > r->sqMapBytes) {
+      r->sqMapBytes = r->cqMapBytes;
+    }
+    r->cqMapBytes = r->sqMapBytes;
+  }
+  r->sqMap = mmap(NULL, r->sqMapBytes, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (r->sqMap == MAP_FAILED) {
+    RingFree(r);
+    return -1;
+  }
+  r->cqMap = (p.features & IORING_FEAT_SINGLE_MMAP)
+                 ? r->sqMap
+                 : mmap(NULL, r->cqMapBytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqesBytes = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = (struct io_uring_sqe *)mmap(NULL, r->sqesBytes,
+                                        PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, r->fd,
+                                        IORING_OFF_SQES);
+  if (r->cqMap == MAP_FAILED || r->sqes == MAP_FAILED) {
+    RingFree(r);
+    return -1;
+  }
+
+  sq = (unsigned char *)r->sqMap;
+  cq = (unsigned char *)r->cqMap;
+  r->sqHead = (unsigned *)(sq + p.sq_off.head);
+  r->sqTail = (unsigned *)(sq + p.sq_off.tail);
+  r->sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sqArray = (unsigned *)(sq + p.sq_off.array);
+  r->cqHead = (unsigned *)(cq + p.cq_off.head);
+  r->cqTail = (unsigned *)(cq + p.cq_off.tail);
+  r->cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+  // pinning the strips saves the kernel from mapping them on every request;
+  // past RLIMIT_MEMLOCK the plain READ / WRITE requests still work
+  for (i = 0; i < URING_DEPTH; i++) {
+    iov[i].iov_base = bufs + (size_t)i * URING_STRIP;
+    iov[i].iov_len = URING_STRIP;
+  }
+  r->fixed = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS,
+                     iov, URING_DEPTH) == 0;
+  return 0;
+}
+
+// Queues the rest of strip 'slot'; io_uring_enter() submits it later
+static void Queue(struct Ring *r, int fd, int write, unsigned char *bufs,
+                  int slot, struct Strip *s) {
+  unsigned tail = *r->sqTail;
+  unsigned idx = tail & *r->sqMask;
+  struct io_uring_sqe *sqe = &r->sqes[idx];
+
+  memset(sqe, 0, sizeof(*sqe));
+  if (r->fixed) {
+    sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->buf_index = slot;
+  } else {
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  }
+  sqe->fd = fd;
+  sqe->off = s->off + s->done;
+  sqe->addr = (uint64_t)(uintptr_t)(bufs + (size_t)slot * URING_STRIP +
+                                    s->done);
+  sqe->len = (unsigned)(s->ioLen - s->done);
+  sqe->user_data = slot;
+  r->sqArray[idx] = idx;
+  // the kernel reads the entry once it sees the new tail
+  __atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+  r->pending++;
+  r->busy++;
+  r->requests++;
+}
+
+// Submits what is queued and waits for at least one completion
+static int Enter(struct Ring *r) {
+  int ret;
+
+  do {
+    ret = (int)syscall(__NR_io_uring_enter, r->fd, r->pending, 1,
+                       IORING_ENTER_GETEVENTS, NULL, 0);
+    r->enters++;
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0) {
+    return -1;
+  }
+  r->pending -= ret;
+  return 0;
+}
+
+// Starts the transfer of the next strip of the file into free slot 'slot'
+static void StartStrip(struct Ring *r, int fd, int write, int direct,
+                       unsigned char *bufs, int slot, struct Strip *s,
+                       size_t *next, size_t fileBytes, UringCopy copy,
+                       void *arg) {
+  s->off = *next;
+  s->len = fileBytes - *next < URING_STRIP ? fileBytes - *next : URING_STRIP;
+  s->ioLen = direct ? (s->len + URING_ALIGN - 1) & ~(size_t)(URING_ALIGN - 1)
+                    : s->len;
+  s->done = 0;
+  *next += s->len;
+  if (write) {
+    unsigned char *buf = bufs + (size_t)slot * URING_STRIP;
+    (*copy)(buf, s->off, s->len, arg);
+    memset(buf + s->len, 0, s->ioLen - s->len); // O_DIRECT padding
+  }
+  Queue(r, fd, write, bufs, slot, s);
+}
+
+int UringTransfer(int fd, int write, int direct, size_t fileBytes,
+                  UringCopy copy, void *arg) {
+  struct Ring r;
+  struct Strip strips[URING_DEPTH];
+  struct io_uring_cqe *cqe;
+  unsigned char *bufs;
+  unsigned head, tail;
+  size_t next = 0;
+  struct Strip *s;
+  int slot, err = 0;
+
+  if (posix_memalign((void **)&bufs, URING_ALIGN,
+                     (size_t)URING_DEPTH * URING_STRIP)) {
+    return -1;
+  }
+  if (RingInit(&r, bufs) != 0) {
+    free(bufs);
+    return -1;
+  }
+
+  for (slot = 0; slot < URING_DEPTH && next < fileBytes; slot++) {
+    StartStrip(&r, fd, write, direct, bufs, slot, &strips[slot], &next,
+               fileBytes, copy, arg);
+  }
+  while (r.busy > 0) {
+    if (Enter(&r) != 0) {
+      err = err ? err : errno;
+      break;
+    }
+    head = *r.cqHead;
+    tail = __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      cqe = &r.cqes[head & *r.cqMask];
+      slot = (int)cqe->user_data;
+      s = &strips[slot];
+      r.busy--;
+      if (err != 0) {
+        continue; // only waiting for the kernel to let go of the strips
+      }
+      if (cqe->res == -EAGAIN || cqe->res == -EINTR) {
+        Queue(&r, fd, write, bufs, slot, s);
+        continue;
+      }
+      if (cqe->res < 0) {
+        err = -cqe->res;
+        continue;
+      }
+      s->done += cqe->res;
+      if (s->done < s->len && cqe->res > 0) {
+        Queue(&r, fd, write, bufs, slot, s); // short transfer, go on
+        continue;
+      }
+      if (!write) {
+        // a read stops short at the end of the file
+        (*copy)(bufs + (size_t)slot * URING_STRIP, s->off,
+                s->done < s->len ? s->done : s->len, arg);
+      }
+      if (next < fileBytes) {
+        StartStrip(&r, fd, write, direct, bufs, slot, s, &next, fileBytes,
+                   copy, arg);
+      }
+    }
+    __atomic_store_n(r.cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  if (err == 0 && write && direct && ftruncate(fd, fileBytes) != 0) {
+    err = errno;
+  }
+  __atomic_fetch_add(&UringRequests, r.requests, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&UringEnters, r.enters, __ATOMIC_RELAXED);
+  RingFree(&r);
+  free(bufs);
+  return err;
+}
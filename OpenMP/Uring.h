@@ -0,0 +1,42 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+
+/*
+ * Asynchronous file transfers through io_uring, on the raw system calls so
+ * no liburing is needed. A file is moved in strips of URING_STRIP bytes
+ * through URING_DEPTH buffers registered with the kernel once per transfer,
+ * so up to URING_DEPTH reads or writes are in flight while the calling thread
+ * copies the pixels in or out of the strips that are done.
+ */
+#define URING_DEPTH 16          // strips in flight
+#define URING_STRIP (256 << 10) // bytes per strip, a multiple of URING_ALIGN
+#define URING_ALIGN 4096        // O_DIRECT buffer, offset and length alignment
+
+/**
+ * UringCopy - Moves the file bytes [fileOff, fileOff + len) between a strip
+ * buffer and wherever the caller keeps them: out of 'buf' after a read, into
+ * 'buf' before a write.
+ */
+typedef void (*UringCopy)(unsigned char *buf, size_t fileOff, size_t len,
+                          void *arg);
+
+/**
+ * UringTransfer - Reads ('write' 0) or writes the first 'fileBytes' bytes of
+ * the file open on 'fd', strip by strip, calling 'copy' for every strip. With
+ * 'direct' the file was opened with O_DIRECT: the last strip is padded to
+ * URING_ALIGN and a written file is then truncated back to 'fileBytes'.
+ * A read that reaches the end of a short file stops there, like fread().
+ *
+ * @return: 0 on success, -1 if io_uring cannot be set up (nothing was
+ *          transferred, the caller should use a synchronous path), or the
+ *          errno of the first request that failed.
+ */
+int UringTransfer(int fd, int write, int direct, size_t fileBytes,
+                  UringCopy copy, void *arg);
+
+// requests submitted and io_uring_enter() calls made, over all transfers
+extern long UringRequests, UringEnters;
+
+#endif
@@ -0,0 +1,305 @@
+/******************************************************************************
+ * DESCRIPTION:
+ *   Benchmark harness for the OpenMP image flips and rotations.
+ *   Every kernel runs on a synthetic image of each requested size, with each
+ *   requested thread count: a few warmup runs, then one timed sample per
+ *   iteration. The median, p95, p99 and standard deviation of the samples are
+ *   written as CSV or JSON, one record per kernel, thread count, size and
+ *   pixel depth, so
+ *   results can be compared across releases. With -g the program only writes
+ *   a synthetic BMP for the other programs to read.
+ ******************************************************************************/
+#include <ctype.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BenchStats.h"
+#include "ImageFlip.h"
+#include "PixelReverse.h"
+
+#define MAXSIZES 16
+#define MAXTHREADCOUNTS 16
+#define MAXDEPTHS 3
+
+struct ImgProp ip;
+
+struct Kernel {
+  char letter;  // flip type, as given to main
+  const char *name;
+  void (*flip)(unsigned char **img);
+  void (*rotate)(unsigned char **dst, unsigned char **src);
+};
+
+/**
+ * PickKernel - Maps a flip type to the function main would run with
+ * 'nthreads' threads: 'V' and 'H' are serial below two threads, 'W' and 'I'
+ * always multi-threaded, 'C', 'A' and 'T' the tiled rotations.
+ *
+ * @return: 0 on success, -1 if the flip type is unknown.
+ */
+int PickKernel(char letter, int nthreads, struct Kernel *k) {
+  memset(k, 0, sizeof(*k));
+  k->letter = letter;
+  switch (letter) {
+  case 'V':
+    k->name = nthreads > 1 ? "FlipVerticalMultiThreaded" : "FlipVertical";
+    k->flip = nthreads > 1 ? FlipVerticalMultiThreaded : FlipVertical;
+    return 0;
+  case 'H':
+    k->name = nthreads > 1 ? "FlipHorizontalMultiThreaded" : "FlipHorizontal";
+    k->flip = nthreads > 1 ? FlipHorizontalMultiThreaded : FlipHorizontal;
+    return 0;
+  case 'W':
+    k->name = "FlipVerticalMultiThreaded";
+    k->flip = FlipVerticalMultiThreaded;
+    return 0;
+  case 'I':
+    k->name = "FlipHorizontalMultiThreaded";
+    k->flip = FlipHorizontalMultiThreaded;
+    return 0;
+  case 'C':
+    k->name = "Rotate90";
+    k->rotate = Rotate90;
+    return 0;
+  case 'A':
+    k->name = "Rotate270";
+    k->rotate = Rotate270;
+    return 0;
+  case 'T':
+    k->name = "Transpose";
+    k->rotate = Transpose;
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+void PrintUsage() {
+  printf("\n\nUsage: bench [-s WxH]... [-d bits]... [-k kernels] [-t threads] "
+         "[-n samples] [-w warmup] [-c] [-f csv|json] [-g out.bmp]");
+  printf("\n\nOptions:");
+  printf("\n  -s  image size, may be repeated (default 3840x2160)");
+  printf("\n  -d  bits per pixel, 8, 24 or 32, may be repeated (default 24)");
+  printf("\n  -k  flip types to run, as for main (default VH)");
+  printf("\n  -t  comma separated thread counts (default 1 and all cores)");
+  printf("\n  -n  timed samples per record (default 31)");
+  printf("\n  -w  untimed warmup runs per record (default 3)");
+  printf("\n  -c  cold runs: flush the caches before every sample");
+  printf("\n  -f  output format, csv (default) or json");
+  printf("\n  -g  only write a synthetic BMP of the first size and depth to "
+         "out.bmp");
+  printf("\n\nExample: bench -s 1920x1080 -s 7680x4320 -k VHC -t 1,4,8 -f json"
+         "\n\n");
+}
+
+/**
+ * RunKernel - Times 'samples' runs of kernel k on img after 'warmup' untimed
+ * ones, flushing the caches before each run when 'cold' is set.
+ *
+ * @param times: receives the samples, in seconds.
+ */
+void RunKernel(const struct Kernel *k, unsigned char **img, unsigned char **dst,
+               int warmup, int samples, int cold, double *times) {
+  double start;
+  int s;
+
+  for (s = -warmup; s < samples; s++) {
+    if (cold) {
+      BenchFlushCaches();
+    }
+    start = BenchNow();
+    if (k->rotate != NULL) {
+      (*k->rotate)(dst, img);
+    } else {
+      (*k->flip)(img);
+    }
+    if (s >= 0) {
+      times[s] = BenchNow() - start;
+    }
+  }
+}
+
+void PrintRecord(const char *format, int first, const struct Kernel *k,
+                 int nthreads, int cold, int warmup, const char *simd,
+                 const struct BenchStats *st) {
+  double pixels = (double)ip.Hpixels * ip.Vpixels;
+  double nsPerPixel = st->median * 1e9 / pixels;
+  // every kernel reads and writes each image byte once
+  double gbps = 2.0 * ip.Hbytes * ip.Vpixels / st->median / 1e9;
+  int padding = (int)(ip.Hbytes - (unsigned long)ip.Hpixels * ip.Bpp);
+
+  if (strcmp(format, "json") == 0) {
+    printf("%s\n  {\"kernel\": \"%c\", \"function\": \"%s\", \"threads\": %d, "
+           "\"width\": %d, \"height\": %d, \"bits\": %d, \"padding\": %d, "
+           "\"cold\": %s, "
+           "\"warmup\": %d, \"samples\": %d, \"min_ms\": %.6f, "
+           "\"median_ms\": %.6f, \"mean_ms\": %.6f, \"p95_ms\": %.6f, "
+           "\"p99_ms\": %.6f, \"max_ms\": %.6f, \"stddev_ms\": %.6f, "
+           "\"ns_per_pixel\": %.4f, \"gb_per_s\": %.3f, \"simd\": \"%s\"}",
+           first ? "[" : ",", k->letter, k->name, nthreads, ip.Hpixels,
+           ip.Vpixels, 8 * ip.Bpp, padding, cold ? "true" : "false", warmup,
+           st->n, st->min * 1e3, st->median * 1e3, st->mean * 1e3, st->p95 * 1e3,
+           st->p99 * 1e3, st->max * 1e3, st->stddev * 1e3, nsPerPixel, gbps,
+           simd);
+  } else {
+    if (first) {
+      printf("kernel,function,threads,width,height,bits,padding,cold,warmup,"
+             "samples,min_ms,median_ms,mean_ms,p95_ms,p99_ms,max_ms,stddev_ms,"
+             "ns_per_pixel,gb_per_s,simd\n");
+    }
+    printf("%c,%s,%d,%d,%d,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,"
+           "%.4f,%.3f,%s\n",
+           k->letter, k->name, nthreads, ip.Hpixels, ip.Vpixels, 8 * ip.Bpp,
+           padding, cold,
+           warmup, st->n, st->min * 1e3, st->median * 1e3, st->mean * 1e3,
+           st->p95 * 1e3, st->p99 * 1e3, st->max * 1e3, st->stddev * 1e3,
+           nsPerPixel, gbps, simd);
+  }
+}
+
+int main(int argc, char **argv) {
+  int widths[MAXSIZES], heights[MAXSIZES], nsizes = 0;
+  int threads[MAXTHREADCOUNTS], nthreadCounts = 0;
+  int depths[MAXDEPTHS], ndepths = 0;
+  char *kernels = "VH", *format = "csv", *genFile = NULL;
+  int samples = 31, warmup = 3, cold = 0, first = 1;
+  int opt, sz, dp, t;
+  char *tok, *c;
+
+  while ((opt = getopt(argc, argv, "s:d:k:t:n:w:cf:g:")) != -1) {
+    switch (opt) {
+    case 's':
+      if (nsizes == MAXSIZES ||
+          sscanf(optarg, "%dx%d", &widths[nsizes], &heights[nsizes]) != 2 ||
+          widths[nsizes] < 1 || heights[nsizes] < 1) {
+        printf("\n\nInvalid image size '%s' ... Exiting ...\n\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      nsizes++;
+      break;
+    case 'd':
+      if (ndepths == MAXDEPTHS || (atoi(optarg) != 8 && atoi(optarg) != 24 &&
+                                   atoi(optarg) != 32)) {
+        printf("\n\nInvalid pixel depth '%s' ... Exiting ...\n\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      depths[ndepths++] = atoi(optarg);
+      break;
+    case 'k':
+      kernels = optarg;
+      break;
+    case 't':
+      for (tok = strtok(optarg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (nthreadCounts < MAXTHREADCOUNTS) {
+          threads[nthreadCounts++] = atoi(tok);
+        }
+      }
+      break;
+    case 'n':
+      samples = atoi(optarg);
+      break;
+    case 'w':
+      warmup = atoi(optarg);
+      break;
+    case 'c':
+      cold = 1;
+      break;
+    case 'f':
+      format = optarg;
+      break;
+    case 'g':
+      genFile = optarg;
+      break;
+    default:
+      PrintUsage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (samples < 1 || warmup < 0 ||
+      (strcmp(format, "csv") != 0 && strcmp(format, "json") != 0)) {
+    PrintUsage();
+    exit(EXIT_FAILURE);
+  }
+  if (nsizes == 0) {
+    widths[0] = 3840;
+    heights[0] = 2160;
+    nsizes = 1;
+  }
+  if (ndepths == 0) {
+    depths[ndepths++] = 24;
+  }
+  if (nthreadCounts == 0) {
+    threads[nthreadCounts++] = 1;
+    if (omp_get_max_threads() > 1) {
+      threads[nthreadCounts++] = omp_get_max_threads();
+    }
+  }
+  for (t = 0; t < nthreadCounts; t++) {
+    if (threads[t] < 1 || threads[t] > omp_get_max_threads()) {
+      printf("\n\nThread counts must be between 1 and %d ... Exiting ...\n\n",
+             omp_get_max_threads());
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (genFile != NULL) {
+    unsigned char **img = GenerateImage(widths[0], heights[0], depths[0]);
+    if (img == NULL) {
+      printf("\n\nCannot allocate the image ... Exiting ...\n\n");
+      exit(EXIT_FAILURE);
+    }
+    WriteBMP(img, genFile);
+    FreeImage(img);
+    return EXIT_SUCCESS;
+  }
+
+  const char *simd = InitPixelReverse();
+  double *times = (double *)malloc(samples * sizeof(double));
+  if (times == NULL) {
+    printf("\n\nCannot allocate the samples ... Exiting ...\n\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (sz = 0; sz < nsizes; sz++) {
+    for (dp = 0; dp < ndepths; dp++) {
+      unsigned char **img = GenerateImage(widths[sz], heights[sz], depths[dp]);
+      // rotations write into an image with the dimensions swapped
+      unsigned char **dst =
+          AllocImage(ip.Hpixels, BMPRowBytes(ip.Vpixels, ip.Bpp));
+      if (img == NULL || dst == NULL) {
+        printf("\n\nCannot allocate a %dx%d image ... Exiting ...\n\n",
+               widths[sz], heights[sz]);
+        exit(EXIT_FAILURE);
+      }
+
+      for (c = kernels; *c; c++) {
+        for (t = 0; t < nthreadCounts; t++) {
+          struct Kernel k;
+          struct BenchStats st;
+
+          if (PickKernel(toupper(*c), threads[t], &k) != 0) {
+            printf("\n\nInvalid flip type '%c' ... Exiting ...\n\n", *c);
+            exit(EXIT_FAILURE);
+          }
+          omp_set_num_threads(threads[t]);
+          RunKernel(&k, img, dst, warmup, samples, cold, times);
+          BenchSummarize(times, samples, &st);
+          PrintRecord(format, first, &k, threads[t], cold, warmup, simd, &st);
+          first = 0;
+          fflush(stdout);
+        }
+      }
+      FreeImage(dst);
+      FreeImage(img);
+    }
+  }
+  if (strcmp(format, "json") == 0) {
+    printf(first ? "[]\n" : "\n]\n");
+  }
+
+  free(times);
+  return EXIT_SUCCESS;
+}
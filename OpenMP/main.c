@@ -11,18 +11,82 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <unistd.h>
 
+#include "Batch.h"
 #include "ImageFlip.h"
+#include "ImageView.h"
+#include "Numa.h"
+#include "Perf.h"
+#include "PixelReverse.h"
+#include "StreamFlip.h"
+#include "Uring.h"
 
 #define REPS 129 // needs to be odd, this is to keep the result consistent
 #define MAXTHREADS omp_get_max_threads()
 
 struct ImgProp ip;
 void (*FlipFunc)(unsigned char **img); // Function pointer to flip the image
+// Function pointer to rotate the image out of place, NULL for the flips
+void (*RotateFunc)(unsigned char **dst, unsigned char **src);
 
 unsigned char **TheImage; // This is the main image
+unsigned char **Rotated;  // Second buffer the rotations ping-pong with
+struct ImgView View;      // Lazy orientation of TheImage (-l)
+
+/**
+ * PickRotateFunction - Selects the rotation for the flip types that change
+ * the image dimensions: 'C' 90 degrees clockwise, 'A' 90 degrees
+ * counter-clockwise (270) and 'T' transpose. The rotations are tiled and use
+ * however many OpenMP threads are set.
+ *
+ * @return: 1 if flipType is a rotation, 0 otherwise.
+ */
+int PickRotateFunction(char flipType) {
+  switch (flipType) {
+  case 'C':
+    RotateFunc = Rotate90;
+    return 1;
+  case 'A':
+    RotateFunc = Rotate270;
+    return 1;
+  case 'T':
+    RotateFunc = Transpose;
+    return 1;
+  default:
+    RotateFunc = NULL;
+    return 0;
+  }
+}
+
+/**
+ * RunLazyChain - Applies the letters of 'chain' to View, each flip in O(1).
+ * A rotation needs the pixels in place, so the view is materialized first,
+ * the image is rotated into Rotated, the two buffers trade places and a new
+ * view starts on the rotated image.
+ */
+void RunLazyChain(const char *chain) {
+  unsigned char **tmp;
+
+  for (const char *c = chain; *c; c++) {
+    if (!PickRotateFunction(toupper(*c))) {
+      ViewApply(&View, toupper(*c));
+      continue;
+    }
+    MaterializeView(&View);
+    (*RotateFunc)(Rotated, TheImage);
+    SetImageSize(ip.Vpixels, ip.Hpixels);
+    tmp = TheImage;
+    TheImage = Rotated;
+    Rotated = tmp;
+    ViewInit(&View, TheImage);
+  }
+}
 
 void PickFlipFunctionSingleThread(char flipType) {
+  if (PickRotateFunction(flipType)) {
+    return;
+  }
   switch (flipType) {
   case 'V':
     FlipFunc = FlipVertical;
@@ -48,9 +112,13 @@ void PickFlipFunctionSingleThread(char flipType) {
  * This function sets the global FlipFunc pointer to the appropriate
  * function for flipping the image.
  *
- * @param flipType: The type of flip to perform ('V', 'H', 'W', 'I').
+ * @param flipType: The type of flip to perform ('V', 'H', 'W', 'I', or one
+ *                  of the rotations 'C', 'A', 'T').
  */
 void PickFlipFunctionMultiThread(char flipType) {
+  if (PickRotateFunction(flipType)) {
+    return;
+  }
   switch (flipType) {
   case 'V':
   case 'W':
@@ -74,43 +142,165 @@ char *flipTypeToString(char flipType) {
   case 'H':
   case 'I':
     return "Horizontal (H)";
+  case 'C':
+    return "Rotate 90 clockwise (C)";
+  case 'A':
+    return "Rotate 90 counter-clockwise (A)";
+  case 'T':
+    return "Transpose (T)";
   default:
     return "Unknown";
   }
 }
 
+void PrintUsage() {
+  printf("\n\nUsage: imflipPM [-t] [-n] [-p] [-l] [-b backend] [-s MB] [-B R,W] input output [v,h,w,i,c,a,t] [0,1-128]");
+  printf("\n\nUse 'V', 'H' for regular, and 'W', 'I' for the memory-friendly "
+         "version of the program\n\n");
+  printf("\n\nUse 'C', 'A' to rotate by 90 degrees clockwise or "
+         "counter-clockwise,\nand 'T' to transpose the image\n\n");
+  printf("\n\nnthreads=0 for the serial version, and 1-128 for the "
+         "Pthreads version\n\n");
+  printf("\n\nOptions:");
+  printf("\n  -t  back the image with transparent huge pages");
+  printf("\n  -n  NUMA mode: pin the threads to the nodes, place each row band "
+         "on the\n      node that flips it and report per-node bandwidth");
+  printf("\n  -p  read the hardware counters of every thread around the flips "
+         "and\n      report IPC and misses per pixel");
+  printf("\n  -l  lazy flips: only record the orientation and move the pixels "
+         "once,\n      while writing. The flip type may then be a chain of "
+         "V, H and R (180)\n      e.g. 'VHV'; a C, A or T in it moves the "
+         "pixels once before rotating");
+  printf("\n  -b  BMP I/O backend: stdio, writev (default), mmap, uring or "
+         "uring-direct\n      (io_uring, the latter with O_DIRECT)");
+  printf("\n  -s  stream the image through strips using at most MB megabytes,"
+         "\n      for images larger than memory (V, H, W, I only)");
+  printf("\n  -B  batch mode: input is a directory of BMPs or a list file and "
+         "output a\n      directory. R reader and W writer threads overlap the "
+         "I/O with the flips\n      (V, H, W, I only)\n\n");
+  printf("\n\nExample: imflipPM infilename.bmp outname.bmp w 8\n\n");
+  printf("\n\nExample: imflipPM infilename.bmp outname.bmp V 0\n\n");
+  printf("\n\nNothing executed ... Exiting ...\n\n");
+}
+
+// wall-clock time in microseconds
+double WallTime() {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return (double)t.tv_sec * 1000000.0 + ((double)t.tv_usec);
+}
+
+/**
+ * RunStreaming - Flips the image out of core with StreamFlip() in a single
+ * pass, within 'budget' bytes, and reports the time and disk throughput.
+ */
+void RunStreaming(char *in, char *out, char flipType, long nthreads,
+                  size_t budget) {
+  double StartTime, TimeElapsed;
+
+  if (flipType != 'V' && flipType != 'W' && flipType != 'H' &&
+      flipType != 'I') {
+    printf("\n\nInvalid flip type ... Exiting ...\n\n");
+    exit(EXIT_FAILURE);
+  }
+
+  const char *revKernel = InitPixelReverse();
+
+  StartTime = WallTime();
+  if (StreamFlip(in, out, flipType, budget) != 0) {
+    printf("\n\nThe memory budget cannot hold a single row ... Exiting "
+           "...\n\n");
+    exit(EXIT_FAILURE);
+  }
+  TimeElapsed = (WallTime() - StartTime) / 1000.00;
+
+  printf("\n\nStreaming read+flip+write time: %9.4f ms  (budget %.2f MB, "
+         "%li threads)",
+         TimeElapsed, budget / (1024.0 * 1024.0), nthreads);
+  printf("\n\nFlip Type = '%s'", flipTypeToString(flipType));
+  printf("\nPixel reversal kernel = %s", revKernel);
+  printf("\nPerformance = %6.3f (ns/pixel)",
+         1000000 * TimeElapsed / (double)(ip.Hpixels * ip.Vpixels));
+  // the file is read once and written once
+  printf("   Disk throughput = %8.2f (MB/s)\n",
+         2.0 * ip.Hbytes * ip.Vpixels / (TimeElapsed * 1000.0));
+}
+
 int main(int argc, char **argv) {
   long nthreads; // Total number of threads working in parallel
   char flipType; // flipType type: V, H, W, I
-  struct timeval t;
-  double StartTime, EndTime, TimeElapsed;
+  char *flipChain = "V"; // all flip letters, used by the lazy view
+  double StartTime, EndTime, TimeElapsed, LoadTime, WriteTime;
+  int opt, lazy = 0, lazyRotations = 0, numa = 0, perf = 0;
+  size_t streamBudget = 0; // bytes, 0 when not streaming
+  int batchReaders = 0, batchWriters = 0; // -B stage threads, 0 when off
 
-  // Read in the parameters
-  switch (argc) {
-  case 3:
+  // Read in the options, then the positional parameters
+  while ((opt = getopt(argc, argv, "tnplb:s:B:")) != -1) {
+    switch (opt) {
+    case 't':
+      UseHugePages = 1;
+      break;
+    case 'n':
+      numa = 1;
+      break;
+    case 'p':
+      perf = 1;
+      break;
+    case 'l':
+      lazy = 1;
+      break;
+    case 'b':
+      BMPBackend = ParseBMPBackend(optarg);
+      if (BMPBackend < 0) {
+        printf("\n\nUnknown I/O backend '%s' ... Exiting ...\n\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 's':
+      streamBudget = (size_t)(atof(optarg) * 1024.0 * 1024.0);
+      if (streamBudget == 0) {
+        printf("\n\nThe streaming budget must be positive ... Exiting "
+               "...\n\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'B':
+      if (sscanf(optarg, "%d,%d", &batchReaders, &batchWriters) != 2 ||
+          batchReaders < 1 || batchWriters < 1) {
+        printf("\n\nThe batch mode needs at least one reader and one writer "
+               "... Exiting ...\n\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+    default:
+      PrintUsage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  int nargs = argc - optind;
+  char **args = argv + optind;
+
+  switch (nargs) {
+  case 2:
     nthreads = 1;
     omp_set_num_threads(nthreads);
     flipType = 'V';
     break;
-  case 4:
+  case 3:
     nthreads = 1;
     omp_set_num_threads(nthreads);
-    flipType = toupper(argv[3][0]);
+    flipChain = args[2];
+    flipType = toupper(args[2][0]);
     break;
-  case 5:
-    nthreads = atoi(argv[4]);
+  case 4:
+    nthreads = atoi(args[3]);
     omp_set_num_threads(nthreads);
-    flipType = toupper(argv[3][0]);
+    flipChain = args[2];
+    flipType = toupper(args[2][0]);
     break;
   default:
-    printf("\n\nUsage: imflipPM input output [v,h,w,i] [0,1-128]");
-    printf("\n\nUse 'V', 'H' for regular, and 'W', 'I' for the memory-friendly "
-           "version of the program\n\n");
-    printf("\n\nnthreads=0 for the serial version, and 1-128 for the "
-           "Pthreads version\n\n");
-    printf("\n\nExample: imflipPM infilename.bmp outname.bmp w 8\n\n");
-    printf("\n\nExample: imflipPM infilename.bmp outname.bmp V 0\n\n");
-    printf("\n\nNothing executed ... Exiting ...\n\n");
+    PrintUsage();
     exit(EXIT_FAILURE);
   }
 
@@ -124,13 +314,84 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
-  TheImage = ReadBMP(argv[1]);
+  if (streamBudget > 0) {
+    if (nthreads == 0) {
+      omp_set_num_threads(1);
+    }
+    RunStreaming(args[0], args[1], flipType, nthreads, streamBudget);
+    return EXIT_SUCCESS;
+  }
+
+  if (batchReaders > 0) {
+    if (nthreads == 0) {
+      omp_set_num_threads(1);
+    }
+    if (PickRotateFunction(flipType)) {
+      printf("\n\nThe batch mode only flips (V, H, W, I) ... Exiting ...\n\n");
+      exit(EXIT_FAILURE);
+    }
+    if (nthreads > 1) {
+      PickFlipFunctionMultiThread(flipType);
+    } else {
+      PickFlipFunctionSingleThread(flipType);
+    }
+    printf("\nPixel reversal kernel = %s", InitPixelReverse());
+    if (RunBatch(args[0], args[1], FlipFunc, batchReaders, batchWriters) < 0) {
+      printf("\n\nCannot build the batch list from %s ... Exiting ...\n\n",
+             args[0]);
+      exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // a lazy flip chain is made of orientation changes and rotations
+  if (lazy) {
+    ViewInit(&View, NULL);
+    for (char *c = flipChain; *c; c++) {
+      if (PickRotateFunction(toupper(*c))) {
+        lazyRotations++;
+      } else if (ViewApply(&View, toupper(*c)) != 0) {
+        printf("\n\nInvalid flip type '%c' ... Exiting ...\n\n", *c);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  // pin the threads before the image is allocated, so it is first touched
+  // from the right nodes; only the multi-threaded flips are partitioned
+  if (numa && !lazy && nthreads > 1) {
+    if (NumaInit() > 0) {
+#pragma omp parallel
+      NumaPinThread(omp_get_thread_num(), omp_get_num_threads());
+    } else {
+      printf("\nSingle NUMA node, -n has no effect\n");
+    }
+  }
+
+  // pick the SIMD pixel reversal kernel once, before anything is timed
+  const char *revKernel = InitPixelReverse();
+
+  StartTime = WallTime();
+  TheImage = ReadBMP(args[0]);
   if (TheImage == NULL) {
     printf("\n\nError reading the input image ... Exiting ...\n\n");
     exit(EXIT_FAILURE);
   }
+  LoadTime = (WallTime() - StartTime) / 1000.00;
+
+  // rotations swap the image dimensions, so they need a second buffer
+  if (lazy ? lazyRotations > 0 : PickRotateFunction(flipType)) {
+    Rotated = AllocImage(ip.Hpixels, BMPRowBytes(ip.Vpixels, ip.Bpp));
+    if (Rotated == NULL) {
+      printf("\n\nCannot allocate the rotated image ... Exiting ...\n\n");
+      exit(EXIT_FAILURE);
+    }
+  }
 
-  if (nthreads == 0 || nthreads == 1) {
+  if (lazy) {
+    printf("\nRecording the flip chain '%s' in a lazy view ...\n", flipChain);
+    ViewInit(&View, TheImage);
+  } else if (nthreads == 0 || nthreads == 1) {
     printf("\nExecuting the serial version ...\n");
     PickFlipFunctionSingleThread(flipType);
   } else {
@@ -139,35 +400,91 @@ int main(int argc, char **argv) {
     PickFlipFunctionMultiThread(flipType);
   }
 
-  gettimeofday(&t, NULL);
-  StartTime = (double)t.tv_sec * 1000000.0 + ((double)t.tv_usec);
+  // every thread that runs the flips opens its own counters
+  if (perf) {
+#pragma omp parallel
+    PerfOpenThread(omp_get_thread_num());
+  }
 
-  for (int a = 0; a < REPS; a++) {
-    (*FlipFunc)(TheImage);
+  StartTime = WallTime();
+  if (perf) {
+    PerfStart();
+  }
+
+  if (lazy) {
+    for (int a = 0; a < REPS; a++) {
+      RunLazyChain(flipChain);
+    }
+  } else if (RotateFunc != NULL) {
+    // REPS is odd, so the last rotation lands in Rotated
+    for (int a = 0; a < REPS; a++) {
+      if (a % 2 == 0) {
+        (*RotateFunc)(Rotated, TheImage);
+      } else {
+        (*RotateFunc)(TheImage, Rotated);
+      }
+      SetImageSize(ip.Vpixels, ip.Hpixels);
+    }
+  } else {
+    for (int a = 0; a < REPS; a++) {
+      (*FlipFunc)(TheImage);
+    }
+  }
+  if (perf) {
+    PerfStop();
   }
 
   printf("\nThe number of threads that was launched is %li\n", nthreads);
 
-  gettimeofday(&t, NULL);
-  EndTime = (double)t.tv_sec * 1000000.0 + ((double)t.tv_usec);
+  EndTime = WallTime();
   TimeElapsed = (EndTime - StartTime) / 1000.00;
   TimeElapsed /= (double)REPS;
 
-  // merge with header and write to file
-  WriteBMP(TheImage, argv[2]);
+  // merge with header and write to file, a lazy view moves its pixels here
+  StartTime = WallTime();
+  if (lazy) {
+    WriteBMPView(&View, args[1]);
+  } else {
+    WriteBMP(RotateFunc != NULL ? Rotated : TheImage, args[1]);
+  }
+  WriteTime = (WallTime() - StartTime) / 1000.00;
 
   // free() the allocated memory for the image
-  for (int i = 0; i < ip.Vpixels; i++) {
-    free(TheImage[i]);
-  }
-  free(TheImage);
+  FreeImage(TheImage);
+  FreeImage(Rotated);
 
-  printf("\n\nTotal execution time: %9.4f ms.  ", TimeElapsed);
+  printf("\n\nLoad time:  %9.4f ms  (%s)%s", LoadTime,
+         BMPBackendName(BMPBackend),
+         UseHugePages ? "  (transparent huge pages)" : "");
+  printf("\nStore time: %9.4f ms  (%s)", WriteTime, BMPBackendName(BMPBackend));
+  if (UringEnters > 0) {
+    printf("\nio_uring:   %ld requests in %ld io_uring_enter calls",
+           UringRequests, UringEnters);
+  }
+  printf("\nTotal execution time: %9.4f ms.  ", TimeElapsed);
   if (nthreads > 1)
     printf("(%9.4f ms per thread).  ", TimeElapsed / (double)nthreads);
-  printf("\n\nFlip Type = '%s'", flipTypeToString(flipType));
-  printf("\nPerformance = %6.3f (ns/pixel)\n",
+  if (lazy) {
+    printf("\n\nFlip Chain = '%s' -> %s (materialized %swhile writing)",
+           flipChain, OrientationToString(View.orient),
+           lazyRotations ? "before each rotation and " : "");
+  } else {
+    printf("\n\nFlip Type = '%s'", flipTypeToString(flipType));
+  }
+  printf("\nPixel reversal kernel = %s", revKernel);
+  printf("\nPerformance = %6.3f (ns/pixel)",
          1000000 * TimeElapsed / (double)(ip.Hpixels * ip.Vpixels));
+  // every flip reads and writes each image byte once
+  if (!lazy) {
+    printf("   Throughput = %6.2f (GB/s)",
+           2.0 * ip.Hbytes * ip.Vpixels / (TimeElapsed * 1000000.0));
+  }
+  NumaReport(nthreads);
+  if (perf) {
+    PerfReport((double)ip.Hpixels * ip.Vpixels * REPS, "pixel");
+    PerfClose();
+  }
+  printf("\n");
 
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
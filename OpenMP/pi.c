@@ -1,9 +1,13 @@
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <unistd.h>
+
+#include "BenchStats.h"
+#include "Perf.h"
 
 #define REPS 5
+#define WARMUP 1 // untimed runs before the REPS samples
 #define MAXTHREADS omp_get_max_threads() // Maximum number of threads
 #define NUM_STEPS 1000000000             // Number of steps for pi calculation
 
@@ -155,8 +159,24 @@ void pick_pi_function(int version_number) {
 
 int main(int argc, char **argv) {
   int version_number = 1; // Version of the pi program to use
-  double StartTime, EndTime, TimeElapsed;
-  struct timeval t;
+  double StartTime, TimeElapsed, times[REPS];
+  struct BenchStats st;
+  int perf = 0, opt;
+
+  // -p reads the hardware counters around the timed reps
+  while ((opt = getopt(argc, argv, "p")) != -1) {
+    switch (opt) {
+    case 'p':
+      perf = 1;
+      break;
+    default:
+      printf("\n\nUsage: pi [-p] [1,2,3,4] [0,1-128]\n\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  // drop the options so argv[1] is the version again
+  argc -= optind - 1;
+  argv += optind - 1;
 
   // Read in the parameters
   switch (argc) {
@@ -176,11 +196,13 @@ int main(int argc, char **argv) {
     omp_set_num_threads(nthreads);
     break;
   default:
-    printf("\n\nUsage: pi [1,2,3,4] [0,1-128]");
+    printf("\n\nUsage: pi [-p] [1,2,3,4] [0,1-128]");
     printf("\n\nThe first number is the version to use for the pi program, the "
            "second number is for the number of threads to be used.\n\n");
     printf("\n\nnthreads=0 for the serial version, and 1-128 for the "
            "Pthreads version\n\n");
+    printf("\n\n-p reports IPC and misses per step from the hardware "
+           "counters\n\n");
     printf("\n\nExample: pi\n\n");
     printf("\n\nExample: pi 1\n\n");
     printf("\n\nExample: pi 2 0\n\n");
@@ -191,21 +213,32 @@ int main(int argc, char **argv) {
 
   pick_pi_function(version_number);
 
-  gettimeofday(&t, NULL);
-  StartTime = (double)t.tv_sec * 1000000.0 + ((double)t.tv_usec);
+  if (perf) {
+#pragma omp parallel
+    PerfOpenThread(omp_get_thread_num());
+  }
 
+  // one sample per rep, after warming up the caches and the thread pool
   double pi = 0.0;
-  for (int rep = 0; rep < REPS; rep++) {
+  for (int rep = -WARMUP; rep < REPS; rep++) {
+    if (perf && rep == 0) {
+      PerfStart();
+    }
+    StartTime = BenchNow();
     pi = (*pi_func)(); // Call the pi function
+    if (rep >= 0) {
+      times[rep] = BenchNow() - StartTime;
+    }
+  }
+  if (perf) {
+    PerfStop();
   }
 
   printf("\nThe number of threads that was launched is %d\n", nthreads);
   printf("\nPi value: %f\n", pi);
 
-  gettimeofday(&t, NULL);
-  EndTime = (double)t.tv_sec * 1000000.0 + ((double)t.tv_usec);
-  TimeElapsed = (EndTime - StartTime) / 1000.00;
-  TimeElapsed /= (double)REPS;
+  BenchSummarize(times, REPS, &st);
+  TimeElapsed = st.mean * 1000.0;
 
   printf("\nAverage Total execution time per REP: %9.4f ms.  ", TimeElapsed);
   if (nthreads > 1)
@@ -214,6 +247,13 @@ int main(int argc, char **argv) {
          nthreads);
   printf("\nPerformance = %6.3f (ns/step)\n",
          1000000 * TimeElapsed / NUM_STEPS);
+  printf("\nPer REP over %d samples: median %9.4f ms  p95 %9.4f ms  "
+         "stddev %9.4f ms\n",
+         st.n, st.median * 1000.0, st.p95 * 1000.0, st.stddev * 1000.0);
+  if (perf) {
+    PerfReport((double)NUM_STEPS * REPS, "step");
+    PerfClose();
+  }
 
   return EXIT_SUCCESS;
 }
\ No newline at end of file